@@ -0,0 +1,570 @@
+// buffercache.cc
+//	Routines to manage the cache of disk sectors.  See buffercache.h.
+//
+//	The lock is never held across a disk transfer; a buffer being
+//	transferred is marked busy instead, and anyone needing it waits
+//	on "changed" until it is not.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "buffercache.h"
+#include "synchdisk.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// BufferFlushDue, BufferFlusher, BufferReadAhead
+// 	Flush timer interrupt handler, and bodies of the flusher and
+//	read-ahead threads.
+//	Need these to be C routines, because C++ can't handle pointers
+//	to member functions.
+//----------------------------------------------------------------------
+
+static void
+BufferFlushDue(int arg)
+{
+    BufferCache *cache = (BufferCache *)arg;
+
+    cache->FlushDue();
+}
+
+static void
+BufferFlusher(int arg)
+{
+    BufferCache *cache = (BufferCache *)arg;
+
+    cache->Flusher();
+}
+
+static void
+BufferReadAhead(int arg)
+{
+    BufferCache *cache = (BufferCache *)arg;
+
+    cache->ReadAhead();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize an empty cache, and fork the threads that flush it
+//	and read ahead into it.
+//
+//	"cachedDisk" -- the disk to cache
+//	"size" -- the number of sector buffers
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(SynchDisk *cachedDisk, int size)
+{
+    Thread *t;
+    int i;
+
+    ASSERT(size > 0);
+    disk = cachedDisk;
+    numBuffers = size;
+    buffers = new CacheBuffer[numBuffers];
+    hash = new CacheBuffer*[numBuffers];
+    for (i = 0; i < numBuffers; i++) {
+	buffers[i].sector = -1;
+	buffers[i].dirty = buffers[i].busy = FALSE;
+	buffers[i].pins = 0;
+	buffers[i].prefetched = FALSE;
+	buffers[i].hashNext = NULL;
+	buffers[i].lruPrev = (i > 0) ? &buffers[i - 1] : NULL;
+	buffers[i].lruNext = (i < numBuffers - 1) ? &buffers[i + 1] : NULL;
+	hash[i] = NULL;
+    }
+    lruHead = &buffers[0];
+    lruTail = &buffers[numBuffers - 1];
+
+    lock = new Lock("buffer cache");
+    changed = new Condition("buffer cache");
+    flushWakeup = new Semaphore("buffer flusher", 0);
+    flushPending = FALSE;
+    prefetchQueue = new SynchList;
+
+    t = new Thread("buffer flusher");
+    t->Fork(BufferFlusher, (void *) this);
+    t = new Thread("read ahead");
+    t->Fork(BufferReadAhead, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	De-allocate the cache.  Dirty buffers are lost, so Flush first.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    delete prefetchQueue;
+    delete flushWakeup;
+    delete changed;
+    delete lock;
+    delete [] hash;
+    delete [] buffers;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Read
+// 	Copy the contents of a sector into "into", reading it from disk
+//	only if it is not cached.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Read(int sector, char *into)
+{
+    CacheBuffer *buf;
+
+    lock->Acquire();
+    buf = GetBuffer(sector, TRUE);
+    bcopy(buf->data, into, SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Write
+// 	Replace the contents of a sector with "from".  The sector is only
+//	written to disk later; since all of it is replaced, it need not be
+//	read in first.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Write(int sector, char *from)
+{
+    CacheBuffer *buf;
+
+    lock->Acquire();
+    buf = GetBuffer(sector, FALSE);
+    bcopy(from, buf->data, SectorSize);
+    MarkDirty(buf);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Pin
+// 	Return the buffer holding "sector", reading it in if need be.
+//	It will not be reused for another sector, nor written back, until
+//	Unpin is called, so the caller may update it in place.
+//----------------------------------------------------------------------
+
+char *
+BufferCache::Pin(int sector)
+{
+    CacheBuffer *buf;
+
+    lock->Acquire();
+    buf = GetBuffer(sector, TRUE);
+    buf->pins++;
+    lock->Release();
+    return buf->data;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Unpin
+// 	Undo a Pin of "sector".  "dirty" says whether the caller modified
+//	the buffer, so that it has to be written back.  A buffer that is
+//	dirty either way is scheduled for a flush, since Flush may have
+//	passed it over while it was pinned.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Unpin(int sector, bool dirty)
+{
+    CacheBuffer *buf;
+
+    lock->Acquire();
+    buf = Lookup(sector);
+    ASSERT(buf != NULL && buf->pins > 0);
+    if (dirty || buf->dirty)
+	MarkDirty(buf);
+    if (--buf->pins == 0)
+	changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+// 	Write every dirty buffer back to disk.  They are written as one
+//	request, in sector order, so that runs of adjacent sectors cost a
+//	single seek.  Pinned buffers are left alone; they are scheduled
+//	for a flush when unpinned.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+    List *dirty = new List;
+    CacheBuffer **bufs;
+    SectorIO *vec;
+    int i, n = 0;
+
+    lock->Acquire();
+    for (i = 0; i < numBuffers; i++)
+	if (buffers[i].dirty && !buffers[i].busy && buffers[i].pins == 0) {
+	    buffers[i].dirty = FALSE;
+	    buffers[i].busy = TRUE;
+	    dirty->SortedInsert((void *) &buffers[i], buffers[i].sector);
+	    n++;
+	}
+    if (n > 0) {
+	bufs = new CacheBuffer*[n];
+	vec = new SectorIO[n];
+	for (i = 0; i < n; i++) {
+	    bufs[i] = (CacheBuffer *) dirty->SortedRemove(&vec[i].sector);
+	    vec[i].data = bufs[i]->data;
+	}
+	DEBUG('f', "Writing back %d sectors.\n", n);
+	lock->Release();
+	disk->WriteRaw(vec, n);
+	lock->Acquire();
+	for (i = 0; i < n; i++)
+	    bufs[i]->busy = FALSE;
+	stats->numCacheWriteBacks += n;
+	changed->Broadcast(lock);
+	delete [] vec;
+	delete [] bufs;
+    }
+    lock->Release();
+    delete dirty;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flusher
+// 	Body of the flusher thread.  Sleeps until the flush interrupt goes
+//	off, then writes back whatever is dirty.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flusher()
+{
+    for (;;) {
+	flushWakeup->P();
+	DEBUG('f', "Flushing buffer cache.\n");
+	Flush();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FlushDue
+// 	Flush timer interrupt handler.  We can't wait for the disk here,
+//	so wake up the flusher to do it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::FlushDue()
+{
+    flushPending = FALSE;
+    flushWakeup->V();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Queue "sectors" to be read into the cache by the read-ahead
+//	thread, and return without waiting for them.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Prefetch(int *sectors, int count)
+{
+    PrefetchRequest *req = new PrefetchRequest;
+
+    req->sectors = new int[count];
+    bcopy((char *) sectors, (char *) req->sectors, count * sizeof(int));
+    req->count = count;
+    prefetchQueue->Append((void *) req);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadAhead
+// 	Body of the read-ahead thread.  For each queued request, claim
+//	clean buffers for the sectors not already cached, and read them
+//	in with one disk request.  Anyone wanting one of them meanwhile
+//	waits for it like for any busy buffer.  If there are no clean
+//	buffers to be had, the rest of the request is dropped: it is not
+//	worth a write-back.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadAhead()
+{
+    PrefetchRequest *req;
+    CacheBuffer *buf, **bufs;
+    SectorIO *fill;
+    int i, n;
+
+    for (;;) {
+	req = (PrefetchRequest *) prefetchQueue->Remove();
+	bufs = new CacheBuffer*[req->count];
+	fill = new SectorIO[req->count];
+	n = 0;
+
+	lock->Acquire();
+	for (i = 0; i < req->count && n < numBuffers / 2; i++) {
+	    if (Lookup(req->sectors[i]) != NULL)
+		continue;
+	    buf = Claim(req->sectors[i], FALSE);
+	    if (buf == NULL)
+		break;
+	    buf->busy = TRUE;
+	    buf->prefetched = TRUE;
+	    bufs[n] = buf;
+	    fill[n].sector = req->sectors[i];
+	    fill[n++].data = buf->data;
+	}
+	if (n > 0) {
+	    DEBUG('f', "Reading ahead %d sectors from %d.\n", n,
+							fill[0].sector);
+	    stats->numReadAheads += n;
+	    FillBuffers(bufs, fill, NULL, n);
+	}
+	lock->Release();
+
+	delete [] fill;
+	delete [] bufs;
+	delete [] req->sectors;
+	delete req;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Lookup
+// 	Return the buffer holding "sector", or NULL if it is not cached.
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Lookup(int sector)
+{
+    CacheBuffer *buf;
+
+    for (buf = hash[sector % numBuffers]; buf != NULL; buf = buf->hashNext)
+	if (buf->sector == sector)
+	    return buf;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+// 	Copy the contents of several sectors into their buffers.  The
+//	ones not cached are collected, and read from disk as one request.
+//	Before we might have to wait -- for a sector someone else is
+//	transferring, or for a buffer to be written back -- whatever has
+//	been collected is read in, so that we never wait while holding
+//	buffers busy ourselves.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSectors(SectorIO *vec, int count)
+{
+    CacheBuffer *buf, **bufs = new CacheBuffer*[count];
+    SectorIO *fill = new SectorIO[count];
+    char **into = new char*[count];
+    int i, n = 0;
+
+    lock->Acquire();
+    for (i = 0; i < count; i++) {
+	buf = Lookup(vec[i].sector);
+	if (buf == NULL && n < numBuffers / 2
+			&& (buf = Claim(vec[i].sector, FALSE)) != NULL) {
+	    stats->numCacheMisses++;
+	    buf->busy = TRUE;
+	    bufs[n] = buf;
+	    fill[n].sector = vec[i].sector;
+	    fill[n].data = buf->data;
+	    into[n++] = vec[i].data;
+	    continue;
+	}
+	if (n > 0 && (buf == NULL || buf->busy)) {
+	    FillBuffers(bufs, fill, into, n);
+	    n = 0;
+	}
+	buf = GetBuffer(vec[i].sector, TRUE);
+	bcopy(buf->data, vec[i].data, SectorSize);
+    }
+    if (n > 0)
+	FillBuffers(bufs, fill, into, n);
+    lock->Release();
+    delete [] into;
+    delete [] fill;
+    delete [] bufs;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FillBuffers
+// 	Read "n" sectors into the buffers claimed for them, with one disk
+//	request, and copy each out to the caller's buffer in "into" (if
+//	"into" is not NULL).  Called with the lock held; gives it up
+//	meanwhile.
+//----------------------------------------------------------------------
+
+void
+BufferCache::FillBuffers(CacheBuffer **bufs, SectorIO *fill, char **into,
+								int n)
+{
+    lock->Release();
+    disk->ReadRaw(fill, n);
+    lock->Acquire();
+    for (int i = 0; i < n; i++) {
+	bufs[i]->busy = FALSE;
+	if (into != NULL)
+	    bcopy(bufs[i]->data, into[i], SectorSize);
+    }
+    changed->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffer
+// 	Return the buffer for "sector", made the most recently used.  If
+//	the sector is not cached, take one over for it, and read the
+//	sector in if "fill" is set.
+//
+//	Called, and returns, with the lock held; may give it up in between
+//	to wait for the disk, so everything is checked again afterwards.
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::GetBuffer(int sector, bool fill)
+{
+    CacheBuffer *buf;
+    SectorIO io;
+
+    for (;;) {
+	buf = Lookup(sector);
+	if (buf != NULL) {
+	    if (buf->busy) {		// wait for its transfer to finish
+		changed->Wait(lock);
+		continue;
+	    }
+	    if (fill) {
+		stats->numCacheHits++;
+		if (buf->prefetched)
+		    stats->numReadAheadHits++;
+		buf->prefetched = FALSE;
+	    }
+	    Touch(buf);
+	    return buf;
+	}
+
+	buf = Claim(sector, TRUE);
+	if (buf == NULL)		// lost the lock; look again
+	    continue;
+	if (fill) {
+	    stats->numCacheMisses++;
+	    buf->busy = TRUE;
+	    io.sector = sector;
+	    io.data = buf->data;
+	    lock->Release();
+	    disk->ReadRaw(&io, 1);
+	    lock->Acquire();
+	    buf->busy = FALSE;
+	    changed->Broadcast(lock);
+	}
+	return buf;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Claim
+// 	Take over the least recently used buffer that is not busy or
+//	pinned, for "sector", which is not cached.  Its old contents are
+//	left as they are.
+//
+//	If that buffer is dirty, or there is none, return NULL: with
+//	"mayWait", after writing it back, or waiting for one to be free
+//	(so the caller must look for the sector again); otherwise at once.
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Claim(int sector, bool mayWait)
+{
+    CacheBuffer *buf, **ptr;
+
+    for (buf = lruHead; buf != NULL; buf = buf->lruNext)
+	if (!buf->busy && buf->pins == 0)
+	    break;
+    if (buf == NULL || buf->dirty) {
+	if (!mayWait)
+	    return NULL;
+	if (buf == NULL)		// all in use; wait for one
+	    changed->Wait(lock);
+	else
+	    WriteOut(buf);
+	return NULL;
+    }
+
+    if (buf->sector != -1) {		// take it out of its old bucket
+	for (ptr = &hash[buf->sector % numBuffers]; *ptr != buf;
+					    ptr = &(*ptr)->hashNext)
+	    ;
+	*ptr = buf->hashNext;
+    }
+    buf->sector = sector;
+    buf->prefetched = FALSE;
+    buf->hashNext = hash[sector % numBuffers];
+    hash[sector % numBuffers] = buf;
+    Touch(buf);
+    return buf;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteOut
+// 	Write a dirty buffer back to disk.  Called with the lock held; the
+//	buffer is busy, so no one touches it, until the write is done.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteOut(CacheBuffer *buf)
+{
+    SectorIO io;
+
+    ASSERT(buf->dirty && !buf->busy);
+    DEBUG('f', "Writing back sector %d.\n", buf->sector);
+    buf->dirty = FALSE;
+    buf->busy = TRUE;
+    io.sector = buf->sector;
+    io.data = buf->data;
+    lock->Release();
+    disk->WriteRaw(&io, 1);
+    lock->Acquire();
+    buf->busy = FALSE;
+    stats->numCacheWriteBacks++;
+    changed->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::MarkDirty
+// 	Note that a buffer has been modified, and make sure the flusher
+//	will get to it within FlushDelay ticks.
+//----------------------------------------------------------------------
+
+void
+BufferCache::MarkDirty(CacheBuffer *buf)
+{
+    buf->dirty = TRUE;
+    if (!flushPending) {
+	flushPending = TRUE;
+	interrupt->Schedule(BufferFlushDue, (int) this, FlushDelay, DiskInt);
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Touch
+// 	Move a buffer to the most recently used end of the LRU list.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Touch(CacheBuffer *buf)
+{
+    if (buf == lruTail)
+	return;
+    if (buf->lruPrev != NULL)		// unlink it...
+	buf->lruPrev->lruNext = buf->lruNext;
+    else
+	lruHead = buf->lruNext;
+    buf->lruNext->lruPrev = buf->lruPrev;
+
+    buf->lruPrev = lruTail;		// ...and put it at the tail
+    buf->lruNext = NULL;
+    lruTail->lruNext = buf;
+    lruTail = buf;
+}
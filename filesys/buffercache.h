@@ -0,0 +1,126 @@
+// buffercache.h
+//	Data structures for a cache of disk sectors, kept in memory in
+//	front of the synchronous disk.
+//
+//	The cache holds a fixed number of sector-sized buffers, found by
+//	a hash on the sector number.  When a sector that is not cached is
+//	needed, the least recently used buffer is taken over.
+//
+//	Writes only go to the cache (write-back); a modified buffer is
+//	written to disk when it is taken over, or by a flusher thread a
+//	while after it was first modified, whichever comes first.
+//
+//	Sectors missing from the cache are read, and dirty buffers flushed,
+//	with multi-sector disk requests where possible.
+//
+//	Sectors can also be read ahead, before anyone asks for them, by a
+//	read-ahead thread, so that the thread asking does not wait (or
+//	waits less).  Only clean buffers are taken over for that.
+//
+//	A buffer can be pinned, so that a metadata update (of a directory
+//	entry, say) can be made in place, without copying the sector out
+//	and back.  A pinned buffer is never taken over.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BUFFERCACHE_H
+#define BUFFERCACHE_H
+
+#include "disk.h"
+#include "synch.h"
+#include "synchlist.h"
+
+#define BufferCacheSize	32	// default number of buffers
+#define FlushDelay	20000	// ticks a buffer may stay dirty before
+				// the flusher writes it back
+
+class SynchDisk;
+
+// One sector's worth of cache.
+
+class CacheBuffer {
+  public:
+    int sector;			// Sector held, or -1 if none
+    bool dirty;			// Modified since last written to disk?
+    bool busy;			// Being read or written right now; no
+				// one may use it until that is done
+    int pins;			// Number of Pin()s not yet undone
+    bool prefetched;		// Read ahead, and not asked for since?
+
+    CacheBuffer *hashNext;	// Next buffer in the same hash bucket
+    CacheBuffer *lruPrev;	// Neighbours in LRU order; the head
+    CacheBuffer *lruNext;	// of the list is the least recently used
+
+    char data[SectorSize];	// The contents of the sector
+};
+
+// Sectors to be read ahead, waiting for the read-ahead thread.
+
+class PrefetchRequest {
+  public:
+    int *sectors;
+    int count;
+};
+
+class BufferCache {
+  public:
+    BufferCache(SynchDisk *cachedDisk, int size);
+				// Initialize a cache of "size" buffers
+				// in front of "synchDisk"
+    ~BufferCache();		// Deallocate it, without writing
+				// anything back
+
+    void Read(int sector, char *into);	// Copy a sector out of the
+    void Write(int sector, char *from);	// cache, or into it
+    void ReadSectors(SectorIO *vec, int count);
+				// Read several, with a single disk
+				// request for the ones not cached
+
+    char *Pin(int sector);	// Return the buffer holding "sector",
+				// which stays put until unpinned
+    void Unpin(int sector, bool dirty);	// Done with it; "dirty" if the
+				// buffer was modified
+
+    void Flush();		// Write back every dirty buffer
+    void Flusher();		// Body of the flusher thread
+    void FlushDue();		// Called by the flush timer interrupt
+
+    void Prefetch(int *sectors, int count);
+				// Start reading these into the cache;
+				// return at once
+    void ReadAhead();		// Body of the read-ahead thread
+
+  private:
+    CacheBuffer *Lookup(int sector);	// The buffer holding "sector"
+    CacheBuffer *GetBuffer(int sector, bool fill);
+				// Find or take over a buffer for
+				// "sector"; read it in if "fill"
+    CacheBuffer *Claim(int sector, bool mayWait);
+				// Take over a buffer for "sector"
+    void FillBuffers(CacheBuffer **bufs, SectorIO *fill, char **into,
+								int n);
+				// Read in claimed sectors
+    void WriteOut(CacheBuffer *buf);	// Write a dirty buffer back
+    void MarkDirty(CacheBuffer *buf);	// Note the buffer was modified
+    void Touch(CacheBuffer *buf);	// Make it the most recently used
+
+    SynchDisk *disk;		// Where the sectors come from
+    int numBuffers;
+    CacheBuffer *buffers;	// The buffers themselves
+    CacheBuffer **hash;		// Buckets, by sector % numBuffers
+    CacheBuffer *lruHead;	// Least recently used buffer
+    CacheBuffer *lruTail;	// Most recently used buffer
+
+    Lock *lock;			// Protects all of the above
+    Condition *changed;		// Signalled when a buffer stops being
+				// busy or pinned
+    Semaphore *flushWakeup;	// To wake the flusher
+    bool flushPending;		// Is the flush interrupt scheduled?
+    SynchList *prefetchQueue;	// PrefetchRequests not yet started
+};
+
+#endif // BUFFERCACHE_H
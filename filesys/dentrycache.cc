@@ -0,0 +1,163 @@
+// dentrycache.cc
+//	Routines to manage the cache of directory lookups.  See
+//	dentrycache.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dentrycache.h"
+#include "system.h"
+#include <cstring>
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize a cache with room for "size" names, none cached.
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache(int size)
+{
+    numEntries = size;
+    entries = new Dentry[size];
+    buckets = new Dentry*[size];
+    for (int i = 0; i < size; i++) {
+	entries[i].parent = -1;
+	entries[i].next = NULL;
+	buckets[i] = NULL;
+    }
+    nextVictim = 0;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	Deallocate the cache.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    delete [] entries;
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Bucket
+// 	Return the hash bucket that "name" in directory "parent" belongs
+//	in.  Only as much of the name as a directory keeps counts.
+//----------------------------------------------------------------------
+
+Dentry **
+DentryCache::Bucket(int parent, char *name)
+{
+    unsigned int hash = parent;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+	hash = hash * 31 + (unsigned char) name[i];
+    return &buckets[hash % numEntries];
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	If the cache knows what "name" in the directory whose header is
+//	at "parent" is, set "sector" and "isDirectory" to it and return
+//	TRUE; "sector" is -1 if there is no such file.  Otherwise return
+//	FALSE, and the caller has to read the directory.
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(int parent, char *name, int *sector, bool *isDirectory)
+{
+    Dentry *entry;
+
+    for (entry = *Bucket(parent, name); entry != NULL; entry = entry->next)
+	if (entry->parent == parent
+			&& !strncmp(entry->name, name, FileNameMaxLen)) {
+	    stats->numDentryHits++;
+	    *sector = entry->sector;
+	    *isDirectory = entry->isDirectory;
+	    return TRUE;
+	}
+    stats->numDentryMisses++;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember that "name" in directory "parent" leads to the file
+//	header at "sector", or to nothing if "sector" is -1.  The oldest
+//	entry is replaced to make room.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(int parent, char *name, int sector, bool isDirectory)
+{
+    Dentry *entry = &entries[nextVictim];
+    Dentry **bucket;
+
+    Invalidate(parent, name);
+    nextVictim = (nextVictim + 1) % numEntries;
+    if (entry->parent != -1)
+	Unlink(entry);
+
+    entry->parent = parent;
+    strncpy(entry->name, name, FileNameMaxLen);
+    entry->name[FileNameMaxLen] = '\0';
+    entry->sector = sector;
+    entry->isDirectory = isDirectory;
+    bucket = Bucket(parent, name);
+    entry->next = *bucket;
+    *bucket = entry;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Invalidate
+// 	Forget what "name" in directory "parent" leads to; it is being
+//	added or removed.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Invalidate(int parent, char *name)
+{
+    Dentry *entry;
+
+    for (entry = *Bucket(parent, name); entry != NULL; entry = entry->next)
+	if (entry->parent == parent
+			&& !strncmp(entry->name, name, FileNameMaxLen)) {
+	    Unlink(entry);
+	    entry->parent = -1;
+	    return;
+	}
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Purge
+// 	Forget every name in directory "parent", which is being removed;
+//	its header sector may be reused for another directory.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Purge(int parent)
+{
+    for (int i = 0; i < numEntries; i++)
+	if (entries[i].parent == parent) {
+	    Unlink(&entries[i]);
+	    entries[i].parent = -1;
+	}
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Unlink
+// 	Take an entry in use out of its hash bucket.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Unlink(Dentry *entry)
+{
+    Dentry **ptr = Bucket(entry->parent, entry->name);
+
+    for (; *ptr != NULL; ptr = &(*ptr)->next)
+	if (*ptr == entry) {
+	    *ptr = entry->next;
+	    return;
+	}
+}
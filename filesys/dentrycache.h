@@ -0,0 +1,70 @@
+// dentrycache.h
+//	Data structures for a cache of directory lookups.
+//
+//	Looking a name up in a directory means opening the directory file
+//	and reading its entries; looking up a path means doing that for
+//	every directory along it.  The cache remembers, for recently
+//	looked up names, which file header each one leads to -- or that
+//	there is no such file, which is worth knowing too, since a file
+//	is looked up before it is created.
+//
+//	An entry is keyed by the sector of the directory's file header
+//	and the name in it.  Directory::Add and Directory::Remove drop the
+//	entry for the name they change, so the cache never disagrees with
+//	the directories on disk.  When the cache is full, entries are
+//	replaced in the order they were made.
+//
+//	We assume mutual exclusion is provided by the caller, as for
+//	directories themselves.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DENTRYCACHE_H
+#define DENTRYCACHE_H
+
+#include "directory.h"
+
+#define DentryCacheSize	256	// names remembered
+
+// One name looked up in one directory.
+
+class Dentry {
+  public:
+    int parent;				// Header sector of the directory, or
+					// -1 if the entry is unused
+    char name[FileNameMaxLen+1];	// The name looked up in it
+    int sector;				// Header sector of the file, or -1
+					// if the directory has no such name
+    bool isDirectory;			// Is the file a directory?
+    Dentry *next;			// Next entry in the same hash bucket
+};
+
+class DentryCache {
+  public:
+    DentryCache(int size);		// Initialize an empty cache
+    ~DentryCache();
+
+    bool Lookup(int parent, char *name, int *sector, bool *isDirectory);
+					// If "name" in directory "parent" is
+					// cached, return TRUE and what it
+					// leads to
+    void Enter(int parent, char *name, int sector, bool isDirectory);
+					// Remember the outcome of a lookup
+    void Invalidate(int parent, char *name);	// The name has changed
+    void Purge(int parent);		// The directory has gone
+
+  private:
+    Dentry **Bucket(int parent, char *name);	// Where "name" would be
+    void Unlink(Dentry *entry);		// Take an entry out of its bucket
+
+    int numEntries;
+    Dentry *entries;			// The entries themselves
+    Dentry **buckets;			// Hash on (parent, name)
+    int nextVictim;			// Entry to be replaced next
+};
+
+#endif // DENTRYCACHE_H
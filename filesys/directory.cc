@@ -7,14 +7,22 @@
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
+//	The first entry holds counts of the others instead (a
+//	DirectoryHeader), the next two are "." and "..", and the rest are
+//	a hash table on the file name, with linear probing.  A removed
+//	entry is marked as such, rather than cleared, so that lookups of
+//	names past it still work; they are cleaned out when the table is
+//	rebuilt, which is also how it grows.
+//
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
+//	FetchFrom reads nothing yet; the counts and each entry are read
+//	when they are first needed.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	Names looked up are entered in the DentryCache, so that looking
+//	them up again, here or as part of a path, need not read the
+//	directory at all.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -24,10 +32,13 @@
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "dentrycache.h"
+#include "system.h"
 #include <cstring>
 
-#define meSector 0
-#define paSector 1
+#define meSector 1
+#define paSector 2
+#define FirstSlot 3		// first entry of the hash table
 
 char* getNameFromDictorySector(int sector)
 {
@@ -40,7 +51,7 @@ char* getNameFromDictorySector(int sector)
     }
     OpenFile* directoryFile = new OpenFile(sector);
     Directory *directory;
-    directory = new Directory(12);
+    directory = new Directory(NumDirEntries);
     directory->FetchFrom(directoryFile);
     char* name = directory->FindEntryName(paSector);
     int fatherSector = directory->Find(name);
@@ -98,12 +109,87 @@ DirectoryEntry::setName(char* newName)
     delete filenameHdr;
     delete filenameFile;
     */
-    strncpy(name, newName, strlen(newName));
-    name[strlen(newName)] = '\0';
+    strncpy(name, newName, FileNameMaxLen);
+    name[FileNameMaxLen] = '\0';
 
 }
 
 
+//----------------------------------------------------------------------
+// FirstComponent
+// 	Copy the first directory name on "path" (as in "/a/b/") into
+//	"component", and return the rest of the path ("/b/").
+//----------------------------------------------------------------------
+
+static char *
+FirstComponent(char *path, char *component)
+{
+    char *begin = path + 1;
+    char *end = begin;
+
+    while (*end != '/')
+        end++;
+    int length = end - begin;
+
+    if (length > FileNameMaxLen)
+        length = FileNameMaxLen;
+    strncpy(component, begin, length);
+    component[length] = '\0';
+    return end;
+}
+
+//----------------------------------------------------------------------
+// FindIn
+// 	Look up "name" on "path" from the directory whose header is at
+//	"dirSector".  Each directory on the way is only read if the
+//	DentryCache does not know the name looked up in it.
+//----------------------------------------------------------------------
+
+static int
+FindIn(int dirSector, char *name, char *path)
+{
+    char component[FileNameMaxLen + 1];
+    int sector;
+    bool isDirectory;
+
+    if (strlen(path) == 1)
+    {
+        if (dentryCache->Lookup(dirSector, name, &sector, &isDirectory))
+            return sector;
+    }
+    else
+    {
+        char *end = FirstComponent(path, component);
+
+        if (dentryCache->Lookup(dirSector, component, &sector, &isDirectory))
+            return (sector == -1 || !isDirectory) ? -1
+                                : FindIn(sector, name, end);
+    }
+
+    OpenFile* directoryFile = new OpenFile(dirSector);
+    Directory* directory = new Directory(NumDirEntries, dirSector);
+    directory->FetchFrom(directoryFile);
+    int _ret = directory->Find(name, path);
+    delete directoryFile;
+    delete directory;
+    return _ret;
+}
+
+//----------------------------------------------------------------------
+// NameHash
+// 	Hash a file name, as far as it is kept in a directory entry.
+//----------------------------------------------------------------------
+
+static unsigned int
+NameHash(char *name)
+{
+    unsigned int hash = 0;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = hash * 31 + (unsigned char) name[i];
+    return hash;
+}
+
 //----------------------------------------------------------------------
 // Directory::Directory
 // 	Initialize a directory; initially, the directory is completely
@@ -116,8 +202,19 @@ DirectoryEntry::setName(char* newName)
 
 Directory::Directory(int size, int thisSector = 1, int fatherSector = 1)
 {
-    table = new DirectoryEntry[size];
-    tableSize = size;
+    ASSERT(size > FirstSlot);
+    Allocate(size);
+    dirFile = NULL;
+    mySector = thisSector;
+    header.numEntries = header.numRemoved = 0;
+
+    for (int i = 0; i < tableSize; i++)
+    {
+        table[i].inUse = FALSE;
+        table[i].removed = FALSE;
+        table[i].isDirectory = FALSE;
+        loaded[i] = dirty[i] = TRUE;
+    }
 
     table[meSector].inUse = TRUE;
     table[meSector].isDirectory = TRUE;
@@ -126,12 +223,6 @@ Directory::Directory(int size, int thisSector = 1, int fatherSector = 1)
     table[paSector].inUse = TRUE;
     table[paSector].isDirectory = TRUE;
     table[paSector].sector = fatherSector;
-
-    for (int i = 2; i < tableSize; i++)
-    {
-	   table[i].inUse = FALSE;
-       table[i].isDirectory = FALSE;
-   }
 }
 
 //----------------------------------------------------------------------
@@ -142,11 +233,29 @@ Directory::Directory(int size, int thisSector = 1, int fatherSector = 1)
 Directory::~Directory()
 { 
     delete [] table;
+    delete [] loaded;
+    delete [] dirty;
 } 
 
+//----------------------------------------------------------------------
+// Directory::Allocate
+// 	Make room in memory for a table of "size" entries; the caller
+//	fills it in.
+//----------------------------------------------------------------------
+
+void
+Directory::Allocate(int size)
+{
+    tableSize = size;
+    table = new DirectoryEntry[size];
+    loaded = new bool[size];
+    dirty = new bool[size];
+}
+
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk -- or rather, get
+//	ready to: the counts and entries are read as they are needed.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
@@ -154,12 +263,37 @@ Directory::~Directory()
 void
 Directory::FetchFrom(OpenFile *file)
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    delete [] table;
+    delete [] loaded;
+    delete [] dirty;
+    Allocate(file->Length() / sizeof(DirectoryEntry));
+    for (int i = 0; i < tableSize; i++)
+        loaded[i] = dirty[i] = FALSE;
+
+    dirFile = file;
+    mySector = file->HeaderSector();
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadHeader
+// 	Read in the counts of entries, if they have not been yet.
+//----------------------------------------------------------------------
+
+void
+Directory::LoadHeader()
+{
+    if (!loaded[0])
+    {
+        (void) dirFile->ReadAt((char *)&header, sizeof(DirectoryHeader), 0);
+        loaded[0] = TRUE;
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk: the counts,
+//	if they changed, and each run of changed entries.  The file grows
+//	if the table has.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
@@ -167,13 +301,148 @@ Directory::FetchFrom(OpenFile *file)
 void
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int first, last;
+
+    if (dirty[0])
+        (void) file->WriteAt((char *)&header, sizeof(DirectoryHeader), 0);
+    dirty[0] = FALSE;
+    for (first = 1; first < tableSize; first = last)
+    {
+        if (!dirty[first])
+        {
+            last = first + 1;
+            continue;
+        }
+        for (last = first + 1; last < tableSize && dirty[last]; last++)
+            ;
+        (void) file->WriteAt((char *)&table[first],
+                        (last - first) * sizeof(DirectoryEntry),
+                        first * sizeof(DirectoryEntry));
+        for (int i = first; i < last; i++)
+            dirty[i] = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::Entry
+// 	Return directory entry "index", reading it from disk if it has not
+//	been yet.  The caller sets dirty[index] if it changes the entry.
+//----------------------------------------------------------------------
+
+DirectoryEntry *
+Directory::Entry(int index)
+{
+    ASSERT(index > 0 && index < tableSize);
+    if (!loaded[index])
+    {
+        (void) dirFile->ReadAt((char *)&table[index], sizeof(DirectoryEntry),
+                                        index * sizeof(DirectoryEntry));
+        loaded[index] = TRUE;
+    }
+    return &table[index];
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadAll
+// 	Read in all the entries not read yet, for the operations that go
+//	through the whole directory.
+//----------------------------------------------------------------------
+
+void
+Directory::LoadAll()
+{
+    DirectoryEntry *buf;
+    int i, j;
+
+    for (i = 1; i < tableSize && loaded[i]; i++)
+        ;
+    if (i == tableSize)
+        return;
+    buf = new DirectoryEntry[tableSize - i];
+    (void) dirFile->ReadAt((char *)buf, (tableSize - i) * sizeof(DirectoryEntry),
+                                        i * sizeof(DirectoryEntry));
+    for (j = i; j < tableSize; j++)
+    {
+        if (!loaded[j])
+        {
+            table[j] = buf[j - i];
+            loaded[j] = TRUE;
+        }
+    }
+    delete [] buf;
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash, Directory::NextSlot
+// 	The entry of the hash table where a search for "name" starts, and
+//	the one searched after entry "i".
+//----------------------------------------------------------------------
+
+int
+Directory::Hash(char *name)
+{
+    return FirstSlot + NameHash(name) % (tableSize - FirstSlot);
+}
+
+int
+Directory::NextSlot(int i)
+{
+    return (i + 1 == tableSize) ? FirstSlot : i + 1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Grow
+// 	Rebuild the hash table without the removed entries, doubling it
+//	if it would otherwise be more than half full.  Every entry is
+//	rewritten by the next WriteBack.
+//----------------------------------------------------------------------
+
+void
+Directory::Grow()
+{
+    DirectoryEntry *oldTable;
+    int oldSize = tableSize, slots = tableSize - FirstSlot, i, j;
+
+    LoadHeader();
+    LoadAll();
+    oldTable = table;
+    delete [] loaded;
+    delete [] dirty;
+    if ((header.numEntries + 1) * 2 > slots)
+        slots *= 2;
+    Allocate(FirstSlot + slots);
+    DEBUG('f', "Rebuilding directory with %d entries, %d slots.\n",
+                                        header.numEntries, slots);
+
+    for (i = 0; i < tableSize; i++)
+    {
+        if (i < FirstSlot)
+            table[i] = oldTable[i];
+        else
+        {
+            table[i].inUse = FALSE;
+            table[i].removed = FALSE;
+        }
+        loaded[i] = dirty[i] = TRUE;
+    }
+    for (i = FirstSlot; i < oldSize; i++)
+    {
+        if (!oldTable[i].inUse)
+            continue;
+        for (j = Hash(oldTable[i].name); table[j].inUse; j = NextSlot(j))
+            ;
+        table[j] = oldTable[i];
+    }
+    header.numRemoved = 0;
+    delete [] oldTable;
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
 // 	Look up file name in directory, and return its location in the table of
 //	directory entries.  Return -1 if the name isn't in the directory.
+//	The search follows the hash chain for "name" up to the first entry
+//	that was never used.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
@@ -181,16 +450,40 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(char *name)
 {
-    //printf("find in Directory %s\n", name);
-    for (int i = 0; i < tableSize; i++)
+    DirectoryEntry *entry;
+    int i = Hash(name);
+
+    for (int n = FirstSlot; n < tableSize; n++)
     {
-        //printf("table[%d]:%s\n", i, table[i].getName());
-        if (table[i].inUse && !strcmp(table[i].getName(), name))
+        entry = Entry(i);
+        if (!entry->inUse && !entry->removed)
+            break;
+        if (entry->inUse && !strncmp(entry->name, name, FileNameMaxLen))
 	       return i;
+        i = NextSlot(i);
     }
     return -1;		// name not in directory
 }
 
+//----------------------------------------------------------------------
+// Directory::RemoveEntry
+// 	Mark entry "i" removed, leaving it in the way of lookups for the
+//	names after it in the hash chain.
+//----------------------------------------------------------------------
+
+void
+Directory::RemoveEntry(int i)
+{
+    DirectoryEntry *entry = Entry(i);
+
+    LoadHeader();
+    entry->inUse = FALSE;
+    entry->removed = TRUE;
+    header.numEntries--;
+    header.numRemoved++;
+    dirty[i] = dirty[0] = TRUE;
+}
+
 //----------------------------------------------------------------------
 // Directory::Find
 // 	Look up file name in directory, and return the disk sector number
@@ -207,56 +500,59 @@ Directory::Find(char *name, char *path = "/", bool findDirectory = FALSE)
     if(findDirectory == TRUE)
     {
         if(!strcmp(".", name))
-            return table[meSector].sector;
+            return Entry(meSector)->sector;
         if(!strcmp("..", name))
-            return table[paSector].sector;
+            return Entry(paSector)->sector;
     }
+    int sector;
+    bool isDirectory;
+
     if(strlen(path) == 1)
     {
-        int i = FindIndex(name);
-
-        if (i != -1)
-        {
-            if(table[i].isDirectory == FALSE && findDirectory == TRUE)
-                return -1;
-            return table[i].sector;
-        }
-
-       return -1;
+        if (!Lookup(name, &sector, &isDirectory))
+            return -1;
+        if(isDirectory == FALSE && findDirectory == TRUE)
+            return -1;
+        return sector;
     }
     else
     {
-        char* end = path;
-        end++;
-        int length = 0;
-        while(*end != '/')
-        {
-            end++;
-        }
-        char* begin = path;
-        begin++;
-        char pathName[length + 1];
-        strncpy(pathName, begin, length);
-        pathName[length] = '\0';
+        char pathName[FileNameMaxLen + 1];
+        char* end = FirstComponent(path, pathName);
 
-        int index = FindIndex(pathName);
-        if (index == -1)
+        if (!Lookup(pathName, &sector, &isDirectory) || !isDirectory)
            return -1;
+        return FindIn(sector, name, end);
+    }
+}
 
-        if (table[index].isDirectory) 
-        {
-            int sector = table[index].sector;
-            OpenFile* directoryFile = new OpenFile(sector);
-            Directory* directory = new Directory(12, sector, 
-                table[meSector].sector);
-            directory->FetchFrom(directoryFile);
-            int _ret = directory->Find(name, end);
-            delete directoryFile;
-            delete directory;
-            return _ret;
-        }
+//----------------------------------------------------------------------
+// Directory::Lookup
+// 	Look up "name" in this directory, through the DentryCache.  Return
+//	TRUE, with the sector of its file header and whether it is a
+//	directory, if it is there.
+//----------------------------------------------------------------------
+
+bool
+Directory::Lookup(char *name, int *sector, bool *isDirectory)
+{
+    int i;
+
+    if (dentryCache->Lookup(mySector, name, sector, isDirectory))
+        return *sector != -1;
+    i = FindIndex(name);
+    if (i == -1)
+    {
+        *sector = -1;
+        *isDirectory = FALSE;
+    }
+    else
+    {
+        *sector = Entry(i)->sector;
+        *isDirectory = Entry(i)->isDirectory;
     }
-    return -1;
+    dentryCache->Enter(mySector, name, *sector, *isDirectory);
+    return i != -1;
 }
 
 //----------------------------------------------------------------------
@@ -277,41 +573,48 @@ Directory::Add(char *name, int newSector, bool isDirectory = FALSE, char* path =
     {
         if (FindIndex(name) != -1)
     	   return FALSE;
-
-        for (int i = 2; i < tableSize; i++)
+        dentryCache->Invalidate(mySector, name);
+
+        // keep the table at most 3/4 full, counting removed entries,
+        // or lookups of names not there get long
+        LoadHeader();
+        if ((header.numEntries + header.numRemoved + 1) * 4
+                                        > (tableSize - FirstSlot) * 3)
+            Grow();
+
+        int i = Hash(name);
+        while (Entry(i)->inUse)
+            i = NextSlot(i);
+        DirectoryEntry *entry = Entry(i);
+
+        if (entry->removed)
+            header.numRemoved--;
+        entry->inUse = TRUE;
+        entry->removed = FALSE;
+        entry->isDirectory = isDirectory;
+        entry->setName(name); 
+        entry->sector = newSector;
+        header.numEntries++;
+        dirty[i] = dirty[0] = TRUE;
+
+        if(isDirectory)
         {
-            if (!table[i].inUse) 
-            {
-                table[i].inUse = TRUE;
-                table[i].isDirectory = isDirectory;
-                table[i].setName(name); 
-                table[i].sector = newSector;
-
- 
-                if(isDirectory)
-                {
-                    Directory* directory = new Directory(12, newSector,
-                        table[meSector].sector);
-                    OpenFile* directoryFile = new OpenFile(newSector);
-                    directory->WriteBack(directoryFile);
-                    delete directoryFile;
-                    delete directory;
-                }
-
-
-
-                FileHeader* fileHdr = new FileHeader();
-                fileHdr->FetchFrom(newSector);
-                fileHdr->setFather(table[meSector].sector);
-                fileHdr->setCreateTime();
-                fileHdr->WriteBack(newSector);
-                delete fileHdr;
+            Directory* directory = new Directory(NumDirEntries, newSector,
+                Entry(meSector)->sector);
+            OpenFile* directoryFile = new OpenFile(newSector);
+            directory->WriteBack(directoryFile);
+            delete directoryFile;
+            delete directory;
+        }
 
+        FileHeader* fileHdr = new FileHeader();
+        fileHdr->FetchFrom(newSector);
+        fileHdr->setFather(Entry(meSector)->sector);
+        fileHdr->setCreateTime();
+        fileHdr->WriteBack(newSector);
+        delete fileHdr;
 
-                return TRUE;
-            }
-    	}
-        return FALSE;	// no space.  Fix when we have extensible files.
+        return TRUE;
     }
     else
     {
@@ -334,12 +637,12 @@ Directory::Add(char *name, int newSector, bool isDirectory = FALSE, char* path =
         if (index == -1)
            return -1;
 
-        if (table[index].isDirectory) 
+        if (Entry(index)->isDirectory) 
         {
-            int sector = table[index].sector;
+            int sector = Entry(index)->sector;
             OpenFile* directoryFile = new OpenFile(sector);
-            Directory* directory = new Directory(12, sector, 
-                table[meSector].sector);
+            Directory* directory = new Directory(NumDirEntries, sector, 
+                Entry(meSector)->sector);
             directory->FetchFrom(directoryFile);
             bool success = directory->Add(name, newSector,
                 isDirectory, end);
@@ -363,15 +666,16 @@ Directory::Add(char *name, int newSector, bool isDirectory = FALSE, char* path =
 bool 
 Directory::RemoveAll()
 {
-    for (int i = 2; i < tableSize; i++)
+    LoadAll();
+    for (int i = FirstSlot; i < tableSize; i++)
     {
-        if(table[i].inUse)
+        if(Entry(i)->inUse)
         {
-            if(table[i].isDirectory)
+            if(Entry(i)->isDirectory)
             {
                 
-                OpenFile* directoryFile = new OpenFile(table[i].sector);
-                Directory* directory = new Directory(12);
+                OpenFile* directoryFile = new OpenFile(Entry(i)->sector);
+                Directory* directory = new Directory(NumDirEntries);
                 directory->FetchFrom(directoryFile);
                 directory->RemoveAll();
                 directory->WriteBack(directoryFile);
@@ -379,29 +683,24 @@ Directory::RemoveAll()
                 delete directoryFile;
             }
             //printf("removeFile in dir\n", table[i].name);
-            table[i].inUse = FALSE;
+            RemoveEntry(i);
 
             BitMap *freeMap;
             FileHeader *fileHdr;
-            OpenFile *freeMapFile = new OpenFile(0);
 
-            int sector = table[i].sector;
+            int sector = Entry(i)->sector;
 
             fileHdr = new FileHeader;
             fileHdr->FetchFrom(sector);
 
-            freeMap = new BitMap(NumSectors);
-            freeMap->FetchFrom(freeMapFile);
-
+            freeMap = fileSystem->AcquireFreeMap();
             fileHdr->Deallocate(freeMap);       // remove data blocks
             freeMap->Clear(sector);         // remove header block
-
-            freeMap->WriteBack(freeMapFile);        // flush to disk
+            fileSystem->ReleaseFreeMap();        // flush to disk
             delete fileHdr;
-            delete freeMap;
-            delete freeMapFile;
         }
     }
+    dentryCache->Purge(mySector);    // the directory is going away
 }
 
 bool
@@ -410,21 +709,22 @@ Directory::Remove(char *name, char* path = "/")
     if(strlen(path) == 1)
     {
         int i = FindIndex(name);
-        if (i < 2)
+        if (i < FirstSlot)
             return FALSE;       // name not in directory
-        if(table[i].isDirectory)
+        if(Entry(i)->isDirectory)
         {
-            int sector = table[i].sector;
+            int sector = Entry(i)->sector;
             OpenFile* directoryFile = new OpenFile(sector);
-            Directory* directory = new Directory(12, sector, 
-                table[meSector].sector);
+            Directory* directory = new Directory(NumDirEntries, sector, 
+                Entry(meSector)->sector);
             directory->FetchFrom(directoryFile);
             directory->RemoveAll();
             directory->WriteBack(directoryFile);
             delete directoryFile;
             delete directory;
         }
-        table[i].inUse = FALSE;
+        RemoveEntry(i);
+        dentryCache->Invalidate(mySector, name);
         return TRUE;
     }
     else
@@ -447,12 +747,12 @@ Directory::Remove(char *name, char* path = "/")
         if (index == -1)
            return -1;
 
-        if (table[index].isDirectory) 
+        if (Entry(index)->isDirectory) 
         {
-            int sector = table[index].sector;
+            int sector = Entry(index)->sector;
             OpenFile* directoryFile = new OpenFile(sector);
-            Directory* directory = new Directory(12, sector, 
-                table[meSector].sector);
+            Directory* directory = new Directory(NumDirEntries, sector, 
+                Entry(meSector)->sector);
             directory->FetchFrom(directoryFile);
             bool success = directory->Remove(name, end);
             directory->WriteBack(directoryFile);
@@ -481,16 +781,17 @@ Directory::List(int deep = 0)
     printf("./\n");
     tab(deep);
     printf("../\n");
-    for (int i = 2; i < tableSize; i++)
+    LoadAll();
+    for (int i = FirstSlot; i < tableSize; i++)
     {
-    	if (table[i].inUse)
+    	if (Entry(i)->inUse)
         {
-            if(table[i].isDirectory)
+            if(Entry(i)->isDirectory)
             {
                 tab(deep);
-                printf("%s/\n", table[i].getName());
-                OpenFile* directoryFile = new OpenFile(table[i].sector);
-                Directory* directory = new Directory(12);
+                printf("%s/\n", Entry(i)->getName());
+                OpenFile* directoryFile = new OpenFile(Entry(i)->sector);
+                Directory* directory = new Directory(NumDirEntries);
                 directory->FetchFrom(directoryFile);
                 directory->List(deep + 1);
                 delete directory;
@@ -499,7 +800,7 @@ Directory::List(int deep = 0)
             else
             {
                 tab(deep);
-    	        printf("%s\n", table[i].getName());
+    	        printf("%s\n", Entry(i)->getName());
             }
         }
     }
@@ -514,11 +815,12 @@ Directory::List(int deep = 0)
 char* 
 Directory::getFileName(int sector)
 {
-    for (int i = 2; i < tableSize; i++)
+    LoadAll();
+    for (int i = FirstSlot; i < tableSize; i++)
     {
-        if (table[i].inUse && table[i].sector == sector) 
+        if (Entry(i)->inUse && Entry(i)->sector == sector) 
         {
-            return table[i].getName(table[meSector].sector);
+            return Entry(i)->getName(Entry(meSector)->sector);
         }
     }
     return NULL;
@@ -530,12 +832,13 @@ Directory::Print()
     FileHeader *hdr = new FileHeader;
 
     printf("Directory contents:\n");
-    for (int i = 2; i < tableSize; i++)
-	if (table[i].inUse) 
+    LoadAll();
+    for (int i = FirstSlot; i < tableSize; i++)
+	if (Entry(i)->inUse) 
     {
 	    printf("Name: %s, Sector: %d\n", 
-            table[i].getName(table[meSector].sector), table[i].sector);
-	    hdr->FetchFrom(table[i].sector);
+            Entry(i)->getName(Entry(meSector)->sector), Entry(i)->sector);
+	    hdr->FetchFrom(Entry(i)->sector);
 	    hdr->Print();
 	}
     printf("\n");
@@ -6,6 +6,11 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	The table is a hash table on the file name, so a name is found
+//	by reading the one or two entries its hash leads to, not the whole
+//	directory.  It is doubled in size, and the file with it, when it
+//	gets three quarters full.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -19,8 +24,12 @@
 
 #include "openfile.h"
 
-#define FileNameMaxLen 		9	// for simplicity, we assume 
-					// file names are <= 9 characters long
+#define FileNameMaxLen 		23	// for simplicity, we assume 
+					// file names are <= 23 characters long
+#define NumDirEntries 		16	// entries a new directory has room
+					// for, counting the header, "." and
+					// ".."; the table grows from there
+#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
@@ -32,6 +41,8 @@
 class DirectoryEntry {
   public:
     bool inUse;				// Is this directory entry in use?
+    bool removed;			// Was it in use, and then removed?
+					// (Lookups have to go on past it.)
     bool isDirectory;
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
@@ -46,6 +57,17 @@ class DirectoryEntry {
     void setName(char* name);
 };
 
+// The first entry of a directory file is taken up by counts of the
+// entries in the hash table, so we know when to grow it without
+// reading it all.
+
+class DirectoryHeader {
+  public:
+    int numEntries;			// Entries in use, besides "." and ".."
+    int numRemoved;			// Entries removed since the table was
+					// last rebuilt
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
@@ -54,12 +76,13 @@ class DirectoryEntry {
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk. 
+// from/to disk.  Entries are only read from disk once they are looked
+// at, and only those changed are written back.
 
 class Directory {
   public:
     Directory(int size, int thisSector = 1, int fatherSector = 1); 		// Initialize an empty directory
-					// with space for "size" files
+					// with "size" entries
     ~Directory();			// De-allocate the directory
 
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
@@ -79,7 +102,7 @@ class Directory {
     void Print();			// Verbose print of the contents
 					//  of the directory -- all the file
 					//  names and their contents.
-    char* FindEntryName(int index){return table[index].getName();}
+    char* FindEntryName(int index){return Entry(index)->getName();}
     char* getFileName(int sector);
 
     bool RemoveAll();
@@ -88,9 +111,26 @@ class Directory {
     int tableSize;			// Number of directory entries
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
-
+    bool *loaded;			// Which entries have been read in
+    bool *dirty;			// Which have been changed since
+    DirectoryHeader header;		// Counts of entries, kept in entry 0
+    OpenFile *dirFile;			// Where the entries not yet loaded
+					// are, or NULL if nowhere
+    int mySector;			// Sector of our own file header, the
+					// key of our names in the DentryCache
+
+    void Allocate(int size);		// Make room for "size" entries
+    DirectoryEntry *Entry(int index);	// Entry "index", read in if need be
+    void LoadHeader();			// Read in the counts
+    void LoadAll();			// Read in every entry
+    int Hash(char *name);		// Where the search for "name" starts
+    int NextSlot(int i);		// Where it goes on after "i"
+    void Grow();			// Rebuild the hash table bigger
+    void RemoveEntry(int i);		// Mark entry "i" removed
     int FindIndex(char *name);		// Find the index into the directory 
 					//  table corresponding to "name"
+    bool Lookup(char *name, int *sector, bool *isDirectory);
+					// Find "name", through the DentryCache
 };
 
 #endif // DIRECTORY_H
@@ -5,11 +5,14 @@
 //	The file header is used to locate where on disk the 
 //	file's data is stored.  We implement this as a fixed size
 //	table of pointers -- each entry in the table points to the 
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect 
-//	blocks). The table size is chosen so that the file header
+//	disk sector containing that portion of the file data, except
+//	for the last two, which point to an indirect and a doubly
+//	indirect block.  The table size is chosen so that the file header
 //	will be just big enough to fit in one disk sector, 
 //
+//	The indirect blocks are cached with the in-memory header once
+//	read, so finding a data sector normally costs no disk I/O.
+//
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
 //
@@ -27,6 +30,53 @@
 #include "system.h"
 #include "filehdr.h"
 
+#define DirectSectors	((int) NumDirect - 2)	// data sectors listed in
+						// the header itself
+#define TableEntries	((int) SectorsInSector)	// sectors listed in an
+						// index table
+#define MaxSectors	(DirectSectors + TableEntries \
+				+ TableEntries * TableEntries)
+
+//----------------------------------------------------------------------
+// IndexSectors
+// 	Return the number of index sectors needed to describe a file of
+//	"numSectors" data sectors.
+//----------------------------------------------------------------------
+
+static int
+IndexSectors(int numSectors)
+{
+    if (numSectors <= DirectSectors)
+        return 0;
+    if (numSectors <= DirectSectors + TableEntries)
+        return 1;
+    return 2 + divRoundUp(numSectors - DirectSectors - TableEntries,
+                                                        TableEntries);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FileHeader
+// 	Initialize a file header with no index tables cached.  Its
+//	contents are set by Allocate or FetchFrom.
+//----------------------------------------------------------------------
+
+FileHeader::FileHeader()
+{
+    indirect = doubleIndirect = NULL;
+    second = NULL;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::~FileHeader
+// 	De-allocate the cached index tables.  Anything modified should
+//	have been written back already.
+//----------------------------------------------------------------------
+
+FileHeader::~FileHeader()
+{
+    DropTables();
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -41,208 +91,92 @@
 bool
 FileHeader::Allocate(BitMap *freeMap, int fileSize)
 { 
-    numBytes = fileSize;
-    numSectors  = divRoundUp(fileSize, SectorSize);
-    if(numSectors <= NumDirect - 2)
-    {
-        if (freeMap->NumClear() < numSectors)
-    	   return FALSE;		// not enough space
-
-        for (int i = 0; i < numSectors; i++)
-    	   dataSectors[i] = freeMap->Find();
-    }
-    else if(numSectors <= NumDirect - 2 + SectorsInSector)
-    {
-        if(freeMap->NumClear() < numSectors + 1)
-            return FALSE;
-        int left = numSectors - (NumDirect-2);
-        for (int i = 0; i < (NumDirect-1); i++) // direct
-            dataSectors[i] = freeMap->Find();
-
-        int sectorTable[SectorsInSector] = {};
-        for(int i = 0; i < left; i++) // indirect
-            sectorTable[i] = freeMap->Find();
-        synchDisk->WriteSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-    }
-    else if(numSectors <= NumDirect - 2 + SectorsInSector
-        + SectorsInSector * SectorsInSector)
-    {
-        int left = numSectors - (NumDirect-2) - SectorsInSector;
-        int indirectSectors = divRoundUp(left, SectorsInSector);
-        if(freeMap->NumClear() < numSectors + 1 + indirectSectors)
-            return FALSE;
-        for (int i = 0; i < NumDirect; i++) // direct
-            dataSectors[i] = freeMap->Find();
-
-        int sectorTable[SectorsInSector] = {};
-        for(int i = 0; i < SectorsInSector; i++) // indirect
-        {
-            sectorTable[i] = freeMap->Find();
-        }
-        synchDisk->WriteSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-
-        int InsectorTable[SectorsInSector] = {};
-        for(int i = 0; i < indirectSectors; i++)
-        {
-            InsectorTable[i] = freeMap->Find();
-            int fillup = left <= SectorsInSector? left:SectorsInSector;
-            left -= SectorsInSector;
-
-            int InInsectorTable[SectorsInSector] = {};
-            for(int j = 0; j < fillup; j++)
-                InInsectorTable[j] = freeMap->Find();
-            synchDisk->WriteSector(InsectorTable[i], 
-                (char*)InInsectorTable);
-        }
-        synchDisk->WriteSector(dataSectors[NumDirect-1],
-            (char*)InsectorTable);
-    }
-    return TRUE;
+    DropTables();
+    allocMode = fileAllocMode;
+    numBytes = numSectors = 0;
+    return AllocateMore(freeMap, fileSize);
 }
 
+//----------------------------------------------------------------------
+// FileHeader::AllocateMore
+// 	Grow the file by "size" bytes, allocating data blocks, and the
+//	index sectors needed to find them, out of the map of free disk
+//	blocks.  Return FALSE, leaving the file as it was, if the file
+//	would get too big or there are not enough free blocks.
+//
+//	The index tables are only changed in memory; WriteBack writes
+//	them to disk along with the header.
+//
+//	Each sector is taken as close as possible after the one before,
+//	so that the file tends to be laid out in order on disk.
+//----------------------------------------------------------------------
+
 bool
 FileHeader::AllocateMore(BitMap *freeMap, int size)
 { 
-    int SectorIndex = 0;
     int totalBytes = numBytes + size;
     int totalSectors = divRoundUp(totalBytes, SectorSize);
-    int newSectors  = totalSectors - numSectors;
-    if(newSectors == 0)
+    IndexTable *table, *top;
+    int i, logi, near;
+
+    if (allocMode == ExtentAlloc)
     {
+        if (!AllocateExtents(freeMap, totalSectors))
+            return FALSE;
         numBytes = totalBytes;
         numSectors = totalSectors;
         return TRUE;
     }
-    if(totalSectors <= NumDirect - 2)
+    if (totalSectors > MaxSectors)
+        return FALSE;           // too big
+    if (freeMap->NumClear() < totalSectors + IndexSectors(totalSectors)
+                                - numSectors - IndexSectors(numSectors))
+        return FALSE;           // not enough space
+
+    near = (numSectors > 0) ? LogicalSectorToSector(numSectors - 1) : 0;
+    for (i = numSectors; i < totalSectors; i++)
     {
-        if (freeMap->NumClear() < newSectors)
-           return FALSE;        // not enough space
-        for (int i = 0; i < totalSectors; i++)
+        if (i < DirectSectors)                      // direct
         {
-            if(SectorIndex >= numSectors)
-            {
-                dataSectors[i] = freeMap->Find();
-            }
-            SectorIndex++;
+            dataSectors[i] = near = freeMap->FindNear(near);
+            continue;
         }
-    }
-    else if(totalSectors <= NumDirect - 2 + SectorsInSector)
-    {
-        int newindirectSectors = numSectors <= (NumDirect-2)? 1:0;
-        if(freeMap->NumClear() < newSectors + newindirectSectors)
-            return FALSE;
-        int left = totalSectors - (NumDirect-2);
-        for (int i = 0; i < (NumDirect-2); i++) // direct
+        logi = i - DirectSectors;
+        if (logi < TableEntries)                    // indirect
         {
-            if(SectorIndex >= numSectors)
-            {
-                dataSectors[i] = freeMap->Find();
-                //printf("direct: %d\n", dataSectors[i]);
-            }
-            SectorIndex++;
-        }
-
-        int sectorTable[SectorsInSector] = {};
-        if(numSectors <= NumDirect - 2)
-            dataSectors[NumDirect-2] = freeMap->Find();
-        else
-            synchDisk->ReadSector(dataSectors[NumDirect-2],
-                (char*)sectorTable);
-
-        for(int i = 0; i < left; i++) // indirect
-        {   
-            if(SectorIndex >= numSectors)
-            {
-                sectorTable[i] = freeMap->Find();
-                //printf("indirect: %d\n", sectorTable[i]);
-            }
-            SectorIndex++;
+            if (logi == 0)
+                dataSectors[NumDirect-2] = near = freeMap->FindNear(near);
+            table = GetTable(&indirect, dataSectors[NumDirect-2], logi == 0);
         }
-        synchDisk->WriteSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-    }
-    else if(totalSectors <= NumDirect - 2 + SectorsInSector
-        + SectorsInSector * SectorsInSector)
-    {
-        int left = totalSectors - (NumDirect-2) - SectorsInSector;
-        int indirectSectors = divRoundUp(left, SectorsInSector);
-        int preleft = divRoundUp(numSectors - 
-            (NumDirect-2) - SectorsInSector, SectorsInSector);
-        if(preleft < 0)
-            preleft = 0;
-        int newindirectSectors = preleft + (
-            numSectors <= (NumDirect-2)?1:0);
-        if(freeMap->NumClear() < newSectors + newindirectSectors)
-            return FALSE;
-        for (int i = 0; i < NumDirect - 2; i++) // direct
+        else                                        // double indirect
         {
-            if(SectorIndex >= numSectors)
+            logi -= TableEntries;
+            if (logi == 0)
+                dataSectors[NumDirect-1] = near = freeMap->FindNear(near);
+            top = GetTable(&doubleIndirect, dataSectors[NumDirect-1],
+                                                                logi == 0);
+            if (logi % TableEntries == 0)
             {
-                dataSectors[i] = freeMap->Find();
-                //printf("direct: %d\n", dataSectors[i]);
+                top->entries[logi / TableEntries] = near =
+                                                freeMap->FindNear(near);
+                top->dirty = TRUE;
             }
-            SectorIndex++;
+            table = SecondTable(logi / TableEntries,
+                top->entries[logi / TableEntries], logi % TableEntries == 0);
+            logi %= TableEntries;
         }
-
-        int sectorTable[SectorsInSector] = {};
-        if(numSectors <= NumDirect - 2)
-            dataSectors[NumDirect-2] = freeMap->Find();
-        else
-            synchDisk->ReadSector(dataSectors[NumDirect-2],
-                (char*)sectorTable);
-        for(int i = 0; i < SectorsInSector; i++) // indirect
-        {   
-            if(SectorIndex >= numSectors)
-            {
-                sectorTable[i] = freeMap->Find();
-                //printf("indirect: %d\n", sectorTable[i]);
-            }
-            SectorIndex++;
-        }
-        synchDisk->WriteSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-
-        int InsectorTable[SectorsInSector] = {};
-        if(numSectors <= NumDirect - 2 + SectorsInSector)
-            dataSectors[NumDirect-1] = freeMap->Find();
-        else
-            synchDisk->ReadSector(dataSectors[NumDirect-1],
-                (char*)InsectorTable);
-        for(int i = 0; i < indirectSectors; i++)
-        {
-            int InInsectorTable[SectorsInSector] = {};
-            if(SectorIndex >= numSectors)
-                InsectorTable[i] = freeMap->Find();
-            else
-                synchDisk->ReadSector(InsectorTable[i],
-                    (char*)InInsectorTable);
-            int fillup = left <= SectorsInSector? left:SectorsInSector;
-            left -= SectorsInSector;
-
-            for(int j = 0; j < fillup; j++)
-            {
-                if(SectorIndex >= numSectors)
-                {
-                    InInsectorTable[j] = freeMap->Find();
-                    //printf("inindirect: %d\n", InInsectorTable[i]);
-                }
-                SectorIndex++;
-            }
-            synchDisk->WriteSector(InsectorTable[i], 
-                (char*)InInsectorTable);
-        }
-        synchDisk->WriteSector(dataSectors[NumDirect-1],
-            (char*)InsectorTable);
+        table->entries[logi] = near = freeMap->FindNear(near);
+        table->dirty = TRUE;
     }
     numBytes = totalBytes;
     numSectors = totalSectors;
     return TRUE;
 }
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and the index sectors pointing to them.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
@@ -250,81 +184,130 @@ FileHeader::AllocateMore(BitMap *freeMap, int size)
 void 
 FileHeader::Deallocate(BitMap *freeMap)
 {
-    if(numSectors <= NumDirect - 2)
+    int i, sector;
+
+    if (allocMode == ExtentAlloc)
     {
-        for (int i = 0; i < numSectors; i++) 
-        {
-            ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-            freeMap->Clear((int) dataSectors[i]);
-        }
+        DeallocateExtents(freeMap);
+        return;
     }
-    else if(numSectors <= NumDirect - 2 + SectorsInSector)
+    for (i = 0; i < numSectors; i++)
     {
-        int left = numSectors - (NumDirect-2);
-
-        int sectorTable[SectorsInSector] = {};
-        synchDisk->ReadSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-        for(int i = 0; i < left; i++) // indirect
-        {
-            ASSERT(freeMap->Test((int) sectorTable[i]));  // ought to be marked!
-            freeMap->Clear((int) sectorTable[i]);
-        }
-
-        for (int i = 0; i < (NumDirect-1); i++) // direct
-        {
-            ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-            freeMap->Clear((int) dataSectors[i]);
-        }
+        sector = LogicalSectorToSector(i);
+        ASSERT(freeMap->Test(sector));  // ought to be marked!
+        freeMap->Clear(sector);
     }
-    else
+    if (numSectors > DirectSectors)
     {
-        int left = numSectors - (NumDirect-2) - SectorsInSector;
-        int indirectSectors = divRoundUp(left, SectorsInSector); 
-
-        int sectorTable[SectorsInSector] = {};
-        synchDisk->ReadSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-        for(int i = 0; i < SectorsInSector; i++) // indirect
+        ASSERT(freeMap->Test(dataSectors[NumDirect-2]));
+        freeMap->Clear(dataSectors[NumDirect-2]);
+    }
+    if (numSectors > DirectSectors + TableEntries)
+    {
+        IndexTable *top = GetTable(&doubleIndirect, dataSectors[NumDirect-1],
+                                                                    FALSE);
+        for (i = 0; i < IndexSectors(numSectors) - 2; i++)
         {
-            ASSERT(freeMap->Test((int) sectorTable[i]));  // ought to be marked!
-            freeMap->Clear((int) sectorTable[i]);
+            ASSERT(freeMap->Test(top->entries[i]));
+            freeMap->Clear(top->entries[i]);
         }
+        ASSERT(freeMap->Test(dataSectors[NumDirect-1]));
+        freeMap->Clear(dataSectors[NumDirect-1]);
+    }
+    DropTables();               // the file is gone; don't write them
+}
 
-        int InsectorTable[SectorsInSector] = {};
-        synchDisk->ReadSector(dataSectors[NumDirect-1],
-            (char*)InsectorTable);
-        for(int i = 0; i < indirectSectors; i++)
-        {
-            int fillup = left <= SectorsInSector? left:SectorsInSector;
-            left -= SectorsInSector;
+//----------------------------------------------------------------------
+// FileHeader::AllocateExtents
+// 	AllocateMore for an ExtentAlloc file: grow it to "totalSectors".
+//	Each run is looked for right after the last one, so that if
+//	possible the last extent just gets longer.  Return FALSE, leaving
+//	the file and "freeMap" as they were, if there is not enough space
+//	or the space is too fragmented for NumExtents runs.
+//----------------------------------------------------------------------
 
-            int InInsectorTable[SectorsInSector] = {};
-            synchDisk->ReadSector(InsectorTable[i], 
-                (char*)InInsectorTable);
-            for(int j = 0; j < fillup; j++)
-            {
-                ASSERT(freeMap->Test((int) InInsectorTable[j]));  // ought to be marked!
-                freeMap->Clear((int) InInsectorTable[j]);
-            }
+bool
+FileHeader::AllocateExtents(BitMap *freeMap, int totalSectors)
+{
+    int saved[NumDirect];
+    int k, covered, near, start, got, i;
+
+    if (freeMap->NumClear() < totalSectors - numSectors)
+        return FALSE;           // not enough space
+    bcopy((char *)dataSectors, (char *)saved, sizeof(dataSectors));
 
-            ASSERT(freeMap->Test((int) InsectorTable[i]));  // ought to be marked!
-            freeMap->Clear((int) InsectorTable[i]);
+    for (k = covered = 0; covered < numSectors; k++)
+        covered += dataSectors[2*k+1];
+    while (covered < totalSectors)
+    {
+        near = (k > 0) ? dataSectors[2*k-2] + dataSectors[2*k-1] : 0;
+        start = freeMap->FindRun(near, totalSectors - covered, &got);
+        ASSERT(start >= 0);
+        if (k > 0 && start == near)
+            dataSectors[2*k-1] += got;          // the last run goes on
+        else if (k < (int) NumExtents)
+        {
+            dataSectors[2*k] = start;
+            dataSectors[2*k+1] = got;
+            k++;
         }
+        else                    // too fragmented: give it all back
+        {
+            for (i = 0; i < got; i++)
+                freeMap->Clear(start + i);
+            for (i = numSectors; i < covered; i++)
+                freeMap->Clear(ExtentToSector(i));
+            bcopy((char *)saved, (char *)dataSectors, sizeof(dataSectors));
+            return FALSE;
+        }
+        covered += got;
+    }
+    return TRUE;
+}
 
+//----------------------------------------------------------------------
+// FileHeader::DeallocateExtents
+// 	Deallocate for an ExtentAlloc file: free every run.
+//----------------------------------------------------------------------
 
+void
+FileHeader::DeallocateExtents(BitMap *freeMap)
+{
+    int k, i, left;
 
-        for (int i = 0; i < NumDirect; i++) // direct
+    for (k = 0, left = numSectors; left > 0; k++)
+    {
+        for (i = 0; i < dataSectors[2*k+1] && i < left; i++)
         {
-            ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-            freeMap->Clear((int) dataSectors[i]);
+            ASSERT(freeMap->Test(dataSectors[2*k] + i));  // ought to be marked!
+            freeMap->Clear(dataSectors[2*k] + i);
         }
+        left -= dataSectors[2*k+1];
     }
 }
 
+//----------------------------------------------------------------------
+// FileHeader::ExtentToSector
+// 	LogicalSectorToSector for an ExtentAlloc file: find the run
+//	holding data sector "logi".
+//----------------------------------------------------------------------
+
+int
+FileHeader::ExtentToSector(int logi)
+{
+    for (int k = 0; k < (int) NumExtents; k++)
+    {
+        if (logi < dataSectors[2*k+1])
+            return dataSectors[2*k] + logi;
+        logi -= dataSectors[2*k+1];
+    }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk. 
+// 	Fetch contents of file header from disk.  Any cached index tables
+//	described the old contents, so they are dropped.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
@@ -332,13 +315,15 @@ FileHeader::Deallocate(BitMap *freeMap)
 void
 FileHeader::FetchFrom(int sector)
 {   
+    DropTables();
     this->sector = sector;
     synchDisk->ReadSector(sector, (char *)this);
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
-// 	Write the modified contents of the file header back to disk. 
+// 	Write the modified contents of the file header back to disk,
+//	along with any index tables modified by AllocateMore.
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
@@ -348,6 +333,105 @@ FileHeader::WriteBack(int sector)
 {
     this->sector = sector;
     synchDisk->WriteSector(sector, (char *)this); 
+    FlushTables();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::GetTable
+// 	Return the index table cached in "slot", reading it in from
+//	"sector" the first time.  If "fresh", the table has just been
+//	allocated, so it starts out empty (and dirty) instead.
+//----------------------------------------------------------------------
+
+IndexTable *
+FileHeader::GetTable(IndexTable **slot, int sector, bool fresh)
+{
+    IndexTable *table = *slot;
+
+    if (table != NULL && !fresh)
+        return table;
+    if (table == NULL)
+        table = *slot = new IndexTable;
+    table->sector = sector;
+    if (fresh)
+    {
+        bzero((char *)table->entries, sizeof(table->entries));
+        table->dirty = TRUE;
+    }
+    else
+    {
+        synchDisk->ReadSector(sector, (char *)table->entries);
+        table->dirty = FALSE;
+    }
+    return table;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SecondTable
+// 	Like GetTable, for the i'th table pointed to by the double
+//	indirect table.
+//----------------------------------------------------------------------
+
+IndexTable *
+FileHeader::SecondTable(int i, int sector, bool fresh)
+{
+    if (second == NULL)
+    {
+        second = new IndexTable*[TableEntries];
+        for (int j = 0; j < TableEntries; j++)
+            second[j] = NULL;
+    }
+    return GetTable(&second[i], sector, fresh);
+}
+
+//----------------------------------------------------------------------
+// FlushTable
+// 	Write one cached index table back to disk, if it was modified.
+//----------------------------------------------------------------------
+
+static void
+FlushTable(IndexTable *table)
+{
+    if (table != NULL && table->dirty)
+    {
+        synchDisk->WriteSector(table->sector, (char *)table->entries);
+        table->dirty = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FlushTables
+// 	Write back every cached index table that was modified.
+//----------------------------------------------------------------------
+
+void
+FileHeader::FlushTables()
+{
+    FlushTable(indirect);
+    FlushTable(doubleIndirect);
+    if (second != NULL)
+        for (int i = 0; i < TableEntries; i++)
+            FlushTable(second[i]);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DropTables
+// 	Forget the cached index tables, without writing them back.
+//----------------------------------------------------------------------
+
+void
+FileHeader::DropTables()
+{
+    delete indirect;
+    delete doubleIndirect;
+    if (second != NULL)
+    {
+        for (int i = 0; i < TableEntries; i++)
+            delete second[i];
+        delete [] second;
+    }
+    indirect = doubleIndirect = NULL;
+    second = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -366,41 +450,32 @@ FileHeader::ByteToSector(int offset)
     return LogicalSectorToSector(offset/SectorSize);
 }
 
+//----------------------------------------------------------------------
+// FileHeader::LogicalSectorToSector
+// 	Return the disk sector holding data sector "logi" of the file, or
+//	-1 if the file is not that long.  The index tables on the way are
+//	read from disk only the first time they are needed.
+//----------------------------------------------------------------------
+
 int 
 FileHeader::LogicalSectorToSector(int logi)
 {
+    IndexTable *top;
+
     if(logi >= numSectors)
         return -1;
-    if(logi < NumDirect - 2)
-    {
+    if(allocMode == ExtentAlloc)
+        return ExtentToSector(logi);
+    if(logi < DirectSectors)
         return dataSectors[logi];
-    }
-    else if(logi < NumDirect - 2 + SectorsInSector)
-    {
-        int left = logi - (NumDirect-2);
-
-        int sectorTable[SectorsInSector] = {};
-        synchDisk->ReadSector(dataSectors[NumDirect-2],
-            (char*)sectorTable);
-
-        return sectorTable[left];
-    }
-    else
-    {
-        int left = logi - (NumDirect-2) - SectorsInSector;
-        int indirectSectors = left/SectorsInSector;
-        int offset = left % SectorsInSector;
-
-        int InsectorTable[SectorsInSector] = {};
-        synchDisk->ReadSector(dataSectors[NumDirect-1],
-            (char*)InsectorTable);
-
-        int InInsectorTable[SectorsInSector] = {};
-        synchDisk->ReadSector(InsectorTable[indirectSectors],
-            (char*)InInsectorTable);
-        return InInsectorTable[offset];
-    }
-    return -1;
+    logi -= DirectSectors;
+    if(logi < TableEntries)
+        return GetTable(&indirect, dataSectors[NumDirect-2], FALSE)
+                                                        ->entries[logi];
+    logi -= TableEntries;
+    top = GetTable(&doubleIndirect, dataSectors[NumDirect-1], FALSE);
+    return SecondTable(logi / TableEntries, top->entries[logi / TableEntries],
+                                FALSE)->entries[logi % TableEntries];
 }
 //----------------------------------------------------------------------
 // FileHeader::FileLength
@@ -459,7 +534,7 @@ FileHeader::getName()
     Directory* directory;
     OpenFile* directoryFile;
     directoryFile = new OpenFile(fatherSector);
-    directory = new Directory(12);
+    directory = new Directory(NumDirEntries);
     directory->FetchFrom(directoryFile);
     char* name = directory->getFileName(sector);
 
@@ -19,9 +19,35 @@
 #include <time.h>
 #include "directory.h"
 
-#define NumDirect 	((SectorSize-5*sizeof(int)-3*sizeof(time_t))/sizeof(int))
+#define NumDirect 	((SectorSize-6*sizeof(int)-3*sizeof(time_t))/sizeof(int))
 #define SectorsInSector  (SectorSize/sizeof(int))
 #define MaxFileSize 	(NumDirect * SectorSize)
+#define NumExtents	(NumDirect / 2)
+
+// How a file's data sectors are recorded in its header.  With
+// BlockAlloc, dataSectors lists every sector, through index tables
+// for all but the first few.  With ExtentAlloc it holds up to
+// NumExtents (start sector, length) pairs, the runs of contiguous
+// sectors making up the file; the allocator tries to continue the
+// last run, so a file written sequentially usually needs only one or
+// two.  The mode is chosen when the file is created, and kept in the
+// header.
+
+enum AllocMode { BlockAlloc, ExtentAlloc };
+
+// The last two entries of the header's table point to index sectors:
+// dataSectors[NumDirect-2] to a table of the next SectorsInSector data
+// sectors, and dataSectors[NumDirect-1] to a table of up to
+// SectorsInSector more tables, for the rest of the file.  While a
+// header is in memory, the index sectors it has looked at are kept
+// with it, as IndexTables.
+
+class IndexTable {
+  public:
+    int sector;				// Where the table lives on disk
+    bool dirty;				// Modified since read or written?
+    int entries[SectorsInSector];	// The sector numbers it holds
+};
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
@@ -34,12 +60,19 @@
 // as one disk sector.  Without indirect addressing, this
 // limits the maximum file length to just under 4K bytes.
 //
-// There is no constructor; rather the file header can be initialized
-// by allocating blocks for the file (if it is a new file), or by
-// reading it from disk.
+// The constructor only sets up the (empty) cache of index tables;
+// the file header is initialized by allocating blocks for the file
+// (if it is a new file), or by reading it from disk.
+//
+// The cached index tables are not part of the on-disk header, so they
+// must come after dataSectors.  AllocateMore updates them in memory;
+// they are written to disk along with the header, by WriteBack.
 
 class FileHeader {
   public:
+    FileHeader();			// Initialize an empty table cache
+    ~FileHeader();			// Deallocate it
+
     bool Allocate(BitMap *bitMap, int fileSize);// Initialize a file header, 
 						//  including allocating space 
 						//  on disk for the file data
@@ -88,11 +121,30 @@ class FileHeader {
     int numSectors;			// Number of data sectors in the file
     int openCount;
     int fatherSector;
+    int allocMode;			// BlockAlloc or ExtentAlloc
     time_t createTime;
     time_t lastAccessTime;
     time_t lastModifyTime;
     int dataSectors[NumDirect];		// Disk sector numbers for each data 
 					// block in the file
+
+    IndexTable *indirect;		// Cached single indirect table,
+    IndexTable *doubleIndirect;		// double indirect table and the
+    IndexTable **second;		// tables it points to; each is NULL
+					// until first needed
+
+    bool AllocateExtents(BitMap *freeMap, int totalSectors);
+    void DeallocateExtents(BitMap *freeMap);
+    int ExtentToSector(int logi);	// The ExtentAlloc versions
+
+    IndexTable *GetTable(IndexTable **slot, int sector, bool fresh);
+					// Return the table cached in "slot",
+					// reading it from "sector", or (if
+					// "fresh") starting it empty
+    IndexTable *SecondTable(int i, int sector, bool fresh);
+					// Same, for the i'th second-level one
+    void FlushTables();			// Write back modified tables
+    void DropTables();			// Forget all cached tables
 };
 
 #endif // FILEHDR_H
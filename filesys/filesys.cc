@@ -49,6 +49,7 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "synch.h"
 #include "system.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
@@ -58,12 +59,9 @@
 #define DirectorySector 	1
 #define FileNameSector      2
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
+// Initial file sizes for the bitmap and directory; the directory grows
+// as files are added to it (see directory.h).
 #define FreeMapFileSize 	(NumSectors / BitsInByte)
-#define NumDirEntries 		12
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
 #define FileNameFileSize 0
 
 #define MaxOpenFile 100
@@ -78,6 +76,8 @@
 //	If format = FALSE, we just have to open the files
 //	representing the bitmap and the directory.
 //
+//	Either way, the bitmap stays in memory from then on.
+//
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
 
@@ -85,7 +85,7 @@ FileSystem::FileSystem(bool format)
 { 
     DEBUG('f', "Initializing the file system.\n");
     if (format) {
-        BitMap *freeMap = new BitMap(NumSectors);
+        freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
 	FileHeader *mapHdr = new FileHeader;
 	FileHeader *dirHdr = new FileHeader;
@@ -139,7 +139,6 @@ FileSystem::FileSystem(bool format)
 	    freeMap->Print();
 	    directory->Print();
 
-        delete freeMap; 
 	delete directory; 
 	delete mapHdr; 
 	delete dirHdr;
@@ -150,7 +149,10 @@ FileSystem::FileSystem(bool format)
     // the bitmap and directory; these are left open while Nachos is running
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap = new BitMap(NumSectors);
+        freeMap->FetchFrom(freeMapFile);
     }
+    freeMapLock = new Lock("free map");
 
     fileEntry = new OpenFile*[MaxOpenFile];
     fileIdMap = new BitMap(MaxOpenFile);
@@ -169,8 +171,8 @@ FileSystem::FileSystem(bool format)
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
 // 	  Allocate space on disk for the data blocks for the file
-//	  Add the name to the directory
 //	  Store the new file header on disk 
+//	  Add the name to the directory
 //	  Flush the changes to the bitmap and the directory back to disk
 //
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
@@ -178,7 +180,7 @@ FileSystem::FileSystem(bool format)
 // 	Create fails if:
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
+//	 	the directory on "path" does not exist
 //	 	no free space for data blocks for the file 
 //
 // 	Note that this implementation assumes there is no concurrent access
@@ -192,7 +194,7 @@ bool
 FileSystem::Create(char *name, int initialSize = 0, char* path = "/")
 {
     Directory *directory;
-    BitMap *freeMap;
+    BitMap *map;
     FileHeader *hdr;
     int sector;
     bool success;
@@ -214,32 +216,36 @@ FileSystem::Create(char *name, int initialSize = 0, char* path = "/")
     if (directory->Find(name, path) != -1)
       success = FALSE;			// file is already in directory
     else {	
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
-        sector = freeMap->Find();	// find a sector to hold the file header
-        freeMap->WriteBack(freeMapFile);
+        map = AcquireFreeMap();
+        sector = map->Find();	// find a sector to hold the file header
+        hdr = new FileHeader;
     	if (sector == -1) 		
             success = FALSE;		// no free block for file header 
-        else if (!directory->Add(name, sector, FALSE, path))
-            success = FALSE;	// no space in directory
-	    else 
+    	else if (!hdr->Allocate(map, initialSize))
         {
-    	    hdr = new FileHeader;
-            freeMap->FetchFrom(freeMapFile);
-    	    if (!hdr->Allocate(freeMap, initialSize))
-                success = FALSE;	// no space on disk for data
-    	    else 
-            {	
-    	    	success = TRUE;
-    		// everthing worked, flush all changes back to disk
-                hdr->setCreateTime();
-        	    hdr->WriteBack(sector);
-                freeMap->WriteBack(freeMapFile); 		
+            success = FALSE;	// no space on disk for data
+            map->Clear(sector);
+        }
+        else
+            success = TRUE;
+        ReleaseFreeMap();	// before the directory, which may grow
+
+        if (success)
+        {
+            hdr->setCreateTime();
+            hdr->WriteBack(sector);
+            if (!directory->Add(name, sector, FALSE, path))
+            {
+                success = FALSE;	// no such path
+                map = AcquireFreeMap();
+                hdr->Deallocate(map);
+                map->Clear(sector);
+                ReleaseFreeMap();
+            }
+            else	// everthing worked, flush all changes back to disk
         	    directory->WriteBack(myDirectoryFile);
-    	    }
-            delete hdr;
-	   }
-        delete freeMap;
+        }
+        delete hdr;
     }
     delete directory;
 
@@ -292,7 +298,7 @@ bool
 FileSystem::CreateDir(char *name, char* path = "/")
 {
     Directory *directory;
-    BitMap *freeMap;
+    BitMap *map;
     FileHeader *hdr;
     int sector;
     bool success;
@@ -315,40 +321,36 @@ FileSystem::CreateDir(char *name, char* path = "/")
     if (directory->Find(name, path) != -1)
       success = FALSE;          // file is already in directory
     else {  
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
-        sector = freeMap->Find();   // find a sector to hold the file header
-        freeMap->WriteBack(freeMapFile);
+        map = AcquireFreeMap();
+        sector = map->Find();   // find a sector to hold the file header
+        hdr = new FileHeader();
         if (sector == -1)       
             success = FALSE;        // no free block for file header 
+        else if (!hdr->Allocate(map, DirectoryFileSize))
+        {
+            success = FALSE;    // no space on disk for data
+            map->Clear(sector);
+        }
         else
+            success = TRUE;
+        ReleaseFreeMap();	// before the directory, which may grow
+
+        if (success)
         {
-            hdr = new FileHeader();
-            freeMap->FetchFrom(freeMapFile);
-            if (!hdr->Allocate(freeMap, DirectoryFileSize))
-                success = FALSE;    // no space on disk for data
-            else
+            hdr->setCreateTime();
+            hdr->WriteBack(sector); 
+            if (!directory->Add(name, sector, TRUE, path))
             {
-                freeMap->WriteBack(freeMapFile);
-                hdr->WriteBack(sector); 
-                if (!directory->Add(name, sector, TRUE, path))
-                {
-                    success = FALSE;    // no space in directory
-                    freeMap->FetchFrom(freeMapFile);
-                    hdr->Deallocate(freeMap);
-                }
-                else
-                {  
-                    success = TRUE;
-            // everthing worked, flush all changes back to disk 
-                    hdr->setCreateTime();
-                    hdr->WriteBack(sector);      
-                    directory->WriteBack(myDirectoryFile);
-                }
-                delete hdr;
+                success = FALSE;    // no such path
+                map = AcquireFreeMap();
+                hdr->Deallocate(map);
+                map->Clear(sector);
+                ReleaseFreeMap();
             }
+            else    // everthing worked, flush all changes back to disk 
+                directory->WriteBack(myDirectoryFile);
         }
-        delete freeMap;
+        delete hdr;
     }
     delete directory;
 
@@ -462,7 +464,7 @@ bool
 FileSystem::Remove(char *name, char *path = "/", bool force = FALSE)
 { 
     Directory *directory;
-    BitMap *freeMap;
+    BitMap *map;
     FileHeader *fileHdr;
     int sector;
 
@@ -495,18 +497,15 @@ FileSystem::Remove(char *name, char *path = "/", bool force = FALSE)
     }
 
 
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
-
-    fileHdr->Deallocate(freeMap);  		// remove data blocks
-    freeMap->Clear(sector);			// remove header block
-    directory->Remove(name, path);
-
-    freeMap->WriteBack(freeMapFile);		// flush to disk
+    directory->Remove(name, path);		// (which frees the
+						// contents of a directory)
+    map = AcquireFreeMap();
+    fileHdr->Deallocate(map);  		// remove data blocks
+    map->Clear(sector);			// remove header block
+    ReleaseFreeMap();				// flush to disk
     directory->WriteBack(myDirectoryFile);        // flush to disk
     delete fileHdr;
     delete directory;
-    delete freeMap;
 
     if(myDirectorySector != 1)
         delete myDirectoryFile;
@@ -544,7 +543,6 @@ FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    BitMap *freeMap = new BitMap(NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
     printf("Bit map file header:\n");
@@ -555,7 +553,6 @@ FileSystem::Print()
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
-    freeMap->FetchFrom(freeMapFile);
     freeMap->Print();
 
     directory->FetchFrom(directoryFile);
@@ -564,10 +561,32 @@ FileSystem::Print()
 
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 } 
 
+//----------------------------------------------------------------------
+// FileSystem::AcquireFreeMap, FileSystem::ReleaseFreeMap
+// 	Get the in-memory bitmap of free sectors, to allocate or free
+//	sectors in, with no other thread using it meanwhile; and give it
+//	up again, writing the words that changed to the bitmap file.  The
+//	write goes through the buffer cache, so several updates to the
+//	same sector reach the disk together.
+//----------------------------------------------------------------------
+
+BitMap *
+FileSystem::AcquireFreeMap()
+{
+    freeMapLock->Acquire();
+    return freeMap;
+}
+
+void
+FileSystem::ReleaseFreeMap()
+{
+    freeMap->WriteDirty(freeMapFile);
+    freeMapLock->Release();
+}
+
 char* FileSystem::currentPath()
 {
     int myDirectorySector = currentThread->myDirectorySector;
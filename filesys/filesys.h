@@ -28,6 +28,9 @@
 //	stored as files in the Nachos file system -- this causes an interesting
 //	bootstrap problem when the simulated disk is initialized. 
 //
+//	The bitmap is read in once and kept in memory while Nachos runs;
+//	after an update only the part that changed is written to its file.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -65,6 +68,8 @@ class FileSystem {
 };
 
 #else // FILESYS
+class Lock;
+
 class FileSystem {
   public:
     FileSystem(bool format);		// Initialize the file system.
@@ -100,6 +105,10 @@ class FileSystem {
 
     void LS();
 
+    BitMap *AcquireFreeMap();		// Get the bitmap of free sectors,
+					// for the caller alone, to update
+    void ReleaseFreeMap();		// Write back what was changed in it,
+					// and let others at it
 
   private:
     OpenFile** fileEntry;
@@ -108,6 +117,8 @@ class FileSystem {
 
     OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
+    BitMap *freeMap;			// Its contents, kept in memory
+    Lock *freeMapLock;			// Held while it is being updated
     OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
 };
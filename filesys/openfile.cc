@@ -34,6 +34,9 @@ OpenFile::OpenFile(int sector)
     hdr->FetchFrom(sector);
     hdr->addOpenCount();
     seekPosition = 0;
+    nextPosition = 0;
+    raWindow = 0;
+    raEnd = 0;
 }
 
 //----------------------------------------------------------------------
@@ -162,12 +165,14 @@ OpenFile::Write(char *into, int numBytes)
 //
 //	For ReadAt:
 //	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   request, but we only copy the part we are interested in.  If the
+//	   read carries on where the last one ended, the sectors after it
+//	   are read ahead; see OpenFile::ReadAhead.
 //	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   Sectors that will be partially written are pinned in the buffer
+//	   cache (which reads them in if need be), so that we don't overwrite
+//	   the unmodified portion, and patched in place.  Full sectors are
+//	   just written.
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -182,6 +187,7 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
     char *buf;
+    SectorIO *vec;
 
     if ((numBytes <= 0) || (position >= fileLength))
     	return 0; 				// check request
@@ -194,77 +200,116 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
+    // sequential?  then grow the read-ahead window, else close it
+    if (position == nextPosition)
+	raWindow = (raWindow == 0) ? MinReadAhead
+				: min(2 * raWindow, MaxReadAhead);
+    else
+	raWindow = raEnd = 0;
+    nextPosition = position + numBytes;
+
+    // read in all the full and partial sectors that we need, as one
+    // request
     buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]); 
+    vec = new SectorIO[numSectors];
+    for (i = firstSector; i <= lastSector; i++) {
+        vec[i - firstSector].sector = hdr->ByteToSector(i * SectorSize);
+        vec[i - firstSector].data = &buf[(i - firstSector) * SectorSize];
+    }
+    synchDisk->ReadSectors(vec, numSectors);
+    delete [] vec;
     hdr->setLastAccessTime();
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete [] buf;
+    if (raWindow > 0)
+	ReadAhead(lastSector);
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Start reading into the buffer cache the "raWindow" sectors of the
+//	file after "lastSector", the last one a sequential read asked
+//	for, so that they are there by the time the next read wants them.
+//	Sectors already read ahead are skipped, so as the reads go on
+//	only the end of the window is asked for each time.
+//
+//	The window doubles with each sequential read, from MinReadAhead up
+//	to MaxReadAhead, and closes as soon as a read goes elsewhere.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead(int lastSector)
+{
+    int first = max(lastSector + 1, raEnd);
+    int last = min(lastSector + raWindow,
+			divRoundUp(hdr->FileLength(), SectorSize) - 1);
+    int *sectors;
+
+    if (first > last)
+	return;
+    sectors = new int[1 + last - first];
+    for (int i = first; i <= last; i++)
+	sectors[i - first] = hdr->LogicalSectorToSector(i);
+    DEBUG('f', "Reading ahead sectors %d to %d of the file.\n", first, last);
+    synchDisk->Prefetch(sectors, 1 + last - first);
+    delete [] sectors;
+    raEnd = last + 1;
+}
+
 int
 OpenFile::WriteAt(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int i, firstSector, lastSector, start, end, sector, numFull = 0;
+    char *data;
+    SectorIO *vec;
 
     if ((numBytes <= 0))
 	   return 0;				// check request
     if ((position + numBytes) > fileLength)
     {
         //printf("po: %d, num: %d, fl: %d\n", position, numBytes, fileLength);
-        BitMap *freeMap;
-        OpenFile *freeMapFile;
-        freeMapFile = new OpenFile(0);
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
+        BitMap *freeMap = fileSystem->AcquireFreeMap();
         int newSize = position + numBytes - fileLength;
         if(!hdr->AllocateMore(freeMap, newSize))
         {
-            delete freeMap;
-            delete freeMapFile;
+            fileSystem->ReleaseFreeMap();
             return 0;
         }
-        freeMap->WriteBack(freeMapFile);
+        fileSystem->ReleaseFreeMap();
         hdr->WriteBack(hdr->getHdrSector());
-        delete freeMap;
-        delete freeMapFile;
         //numBytes = fileLength - position;
     }
     DEBUG('f', "Writing %d bytes at %d, from file of length %d.\n", 	
 			numBytes, position, fileLength);
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
+    vec = new SectorIO[1 + lastSector - firstSector];
 
-    buf = new char[numSectors * SectorSize];
-
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
-
-// read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
-
-// copy in the bytes we want to change 
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
-
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+// write whole sectors straight from the caller's buffer, together; patch
+// the first and last sector, if they are only partially modified, in
+// place in the buffer cache
+    for (i = firstSector; i <= lastSector; i++) {
+        sector = hdr->ByteToSector(i * SectorSize);
+        start = max(position, i * SectorSize);
+        end = min(position + numBytes, (i + 1) * SectorSize);
+        if (end - start == SectorSize) {
+            vec[numFull].sector = sector;
+            vec[numFull++].data = &from[start - position];
+        } else {
+            data = synchDisk->PinSector(sector);
+            bcopy(&from[start - position], &data[start - i * SectorSize],
+                                                        end - start);
+            synchDisk->UnpinSector(sector, TRUE);
+        }
+    }
+    if (numFull > 0)
+        synchDisk->WriteSectors(vec, numFull);
+    delete [] vec;
 
     hdr->setLastModifyTime();
-    delete [] buf;
     return numBytes;
 }
 
@@ -278,3 +323,15 @@ OpenFile::Length()
 { 
     return hdr->FileLength(); 
 }
+
+//----------------------------------------------------------------------
+// OpenFile::HeaderSector
+// 	Return the sector holding the file header, so that the file can
+//	be opened again, independently of this OpenFile.
+//----------------------------------------------------------------------
+
+int
+OpenFile::HeaderSector()
+{
+    return hdr->getHdrSector();
+}
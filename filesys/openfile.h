@@ -61,6 +61,10 @@ class OpenFile {
 #else // FILESYS
 class FileHeader;
 
+#define MinReadAhead	2	// sectors read ahead when a file is first
+				// seen being read sequentially
+#define MaxReadAhead	32	// the most the window grows to
+
 class OpenFile {
   public:
     OpenFile(int sector);		// Open a file whose header is located
@@ -85,9 +89,20 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+    int HeaderSector();			// Sector of the file header, to open
+					// the file again with
   private:
+    void ReadAhead(int lastSector);	// Prefetch the sectors following
+					// a sequential read
+
     FileHeader *hdr;            // Header for this file 
     int seekPosition;			// Current position within the file
+    int nextPosition;			// Where the last ReadAt ended; a
+					// read starting here is sequential
+    int raWindow;			// Sectors to read ahead, or 0 if
+					// reads are not sequential
+    int raEnd;				// First sector of the file not yet
+					// read ahead
 };
 
 #endif // FILESYS
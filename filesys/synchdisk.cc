@@ -7,8 +7,13 @@
 //
 //	Use a semaphore to synchronize the interrupt handlers with the
 //	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	handle one operation at a time, requests made while it is busy
+//	are queued; the interrupt handler starts the next one.  The queue
+//	is shared with the interrupt handler, so it is only touched with
+//	interrupts off.
+//
+//	Requests are served from a BufferCache where possible; only the
+//	cache talks to the disk itself, through ReadRaw and WriteRaw.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -18,6 +23,8 @@
 #include "synchdisk.h"
 #include "system.h"
 
+char *diskSchedNames[] = { "fifo", "scan", "clook", "sstf" };
+
 //----------------------------------------------------------------------
 // DiskRequestDone
 // 	Disk interrupt handler.  Need this to be a C routine, because 
@@ -39,13 +46,19 @@ DiskRequestDone (int arg)
 //
 //	"name" -- UNIX file name to be used as storage for the disk data
 //	   (usually, "DISK")
+//	"cacheSize" -- number of sectors to keep in the buffer cache
+//	"policy" -- how to order requests waiting for the disk
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk(char* name)
+SynchDisk::SynchDisk(char* name, int cacheSize, DiskSched policy)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
+    sched = policy;
+    active = queue = NULL;
+    headSector = 0;
+    direction = 1;
+    stats->diskSched = diskSchedNames[policy];
     disk = new Disk(name, DiskRequestDone, (int) this);
+    cache = new BufferCache(this, cacheSize);
 }
 
 //----------------------------------------------------------------------
@@ -56,9 +69,8 @@ SynchDisk::SynchDisk(char* name)
 
 SynchDisk::~SynchDisk()
 {
+    delete cache;
     delete disk;
-    delete lock;
-    delete semaphore;
 }
 
 //----------------------------------------------------------------------
@@ -73,16 +85,14 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    cache->Read(sectorNumber, data);
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
-// 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+// 	Write the contents of a buffer into a disk sector.  The data is
+//	copied into the cache, so the buffer may be reused on return;
+//	it reaches the disk later.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -91,20 +101,216 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();         // wait for interrupt
-    lock->Release();
+    cache->Write(sectorNumber, data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors, SynchDisk::WriteSectors
+// 	Read/write several sectors, each with its own buffer.  Sectors
+//	not in the cache are read from disk with one request (or a few,
+//	if there are many), rather than one request per sector.
+//
+//	"vec" -- the sectors, and the buffers to hold their contents
+//	"count" -- the number of sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(SectorIO *vec, int count)
+{
+    cache->ReadSectors(vec, count);
+}
+
+void
+SynchDisk::WriteSectors(SectorIO *vec, int count)
+{
+    for (int i = 0; i < count; i++)
+	cache->Write(vec[i].sector, vec[i].data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Prefetch
+// 	Start reading some sectors into the cache, expecting them to be
+//	asked for soon.  Return at once; the read happens in the
+//	background, if there is room in the cache for it at all.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Prefetch(int *sectors, int count)
+{
+    cache->Prefetch(sectors, count);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::PinSector, SynchDisk::UnpinSector
+// 	Get at the cached copy of a sector, to read or modify part of it
+//	in place; and give it up again, saying whether it was modified.
+//----------------------------------------------------------------------
+
+char *
+SynchDisk::PinSector(int sectorNumber)
+{
+    return cache->Pin(sectorNumber);
+}
+
+void
+SynchDisk::UnpinSector(int sectorNumber, bool dirty)
+{
+    cache->Unpin(sectorNumber, dirty);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Write every modified sector in the cache to disk.  Return once
+//	they have been written.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    cache->Flush();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadRaw
+// 	Read the contents of some disk sectors into their buffers, from
+//	the disk itself, as a single request.  Return only after the data
+//	has been read.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadRaw(SectorIO *vec, int count)
+{
+    Request(vec, count, FALSE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteRaw
+// 	Write the contents of some buffers into their disk sectors, on
+//	the disk itself, as a single request.  Return only after the data
+//	has been written.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteRaw(SectorIO *vec, int count)
+{
+    Request(vec, count, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Request
+// 	Send a request to the disk if it is idle, otherwise queue it, and
+//	wait until it is done.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Request(SectorIO *vec, int count, bool writing)
+{
+    DiskRequest *req = new DiskRequest, **ptr;
+    IntStatus oldLevel;
+
+    req->vec = vec;
+    req->count = count;
+    req->writing = writing;
+    req->done = new Semaphore("disk request", 0);
+    req->next = NULL;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    stats->numDiskRequests++;
+    if (active == NULL)
+	Start(req);
+    else {
+	stats->diskQueueDepth++;		// count the one in service
+	for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next)
+	    stats->diskQueueDepth++;
+	*ptr = req;
+    }
+    (void) interrupt->SetLevel(oldLevel);
+
+    req->done->P();			// wait for interrupt
+    delete req->done;
+    delete req;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Start
+// 	Send a request to the disk.  Called with interrupts off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Start(DiskRequest *req)
+{
+    active = req;
+    headSector = req->vec[req->count - 1].sector;
+    if (req->writing)
+	disk->WriteSectors(req->vec, req->count);
+    else
+	disk->ReadSectors(req->vec, req->count);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Take the request to serve next off the queue, or return NULL if
+//	it is empty.  A request is placed by its first sector; the head
+//	is at the last sector of the previous request.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::NextRequest()
+{
+    DiskRequest **ptr, **best = NULL;
+    int dist, bestDist = 0, lowest = 0;
+
+    if (queue == NULL || sched == FIFOSched)
+	best = &queue;
+    else if (sched == SSTFSched) {
+	for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next) {
+	    dist = abs((*ptr)->vec[0].sector - headSector);
+	    if (best == NULL || dist < bestDist) {
+		best = ptr;
+		bestDist = dist;
+	    }
+	}
+    } else {
+	for (int pass = 0; best == NULL; pass++) {
+	    ASSERT(pass < 2);
+	    for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next) {
+		dist = ((*ptr)->vec[0].sector - headSector) * direction;
+		if (sched == CLOOKSched && dist < 0) {
+		    if (pass == 1 && (best == NULL
+				|| (*ptr)->vec[0].sector < lowest)) {
+			best = ptr;	// wrapped: the lowest of them all
+			lowest = (*ptr)->vec[0].sector;
+		    }
+		} else if (dist >= 0 && (best == NULL || dist < bestDist)) {
+		    best = ptr;
+		    bestDist = dist;
+		}
+	    }
+	    if (best == NULL && sched == SCANSched)
+		direction = -direction;	// nothing ahead: turn around
+	}
+    }
+
+    DiskRequest *req = *best;
+    if (req != NULL)
+	*best = req->next;
+    return req;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Wake up the thread waiting for the disk
+//	request to finish, and start the next request, if any.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::RequestDone()
 { 
-    semaphore->V();
+    DiskRequest *req = active;
+    DiskRequest *next = NextRequest();
+
+    active = NULL;
+    if (next != NULL)
+	Start(next);
+    req->done->V();
 }
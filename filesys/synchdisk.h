@@ -13,6 +13,27 @@
 
 #include "disk.h"
 #include "synch.h"
+#include "buffercache.h"
+
+// How the next request is chosen, among those waiting for the disk,
+// when it finishes one.  FIFO takes them in order of arrival; SCAN
+// keeps the head moving one way while there are requests ahead of
+// it, then turns around; C-LOOK only serves requests moving up,
+// jumping back to the lowest one at the top; SSTF takes the one
+// nearest the head.
+enum DiskSched { FIFOSched, SCANSched, CLOOKSched, SSTFSched,
+							NumDiskScheds };
+extern char *diskSchedNames[];		// "fifo", "scan", "clook", "sstf"
+
+// A request waiting for, or being served by, the disk.
+class DiskRequest {
+  public:
+    SectorIO *vec;			// The sectors to transfer
+    int count;
+    bool writing;
+    Semaphore *done;			// Signalled when it completes
+    DiskRequest *next;			// Next in the queue
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -23,31 +44,66 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  Requests made while the disk is busy are queued, and the
+// next is started, in the order the DiskSched says, as soon as the
+// disk is done with the current one.
+//
+// Sectors go through a BufferCache, so a request for a recently used
+// sector usually does not wait for the disk at all, and writes reach
+// the disk some time later.
 class SynchDisk {
   public:
-    SynchDisk(char* name);    		// Initialize a synchronous disk,
-					// by initializing the raw Disk.
+    SynchDisk(char* name, int cacheSize, DiskSched policy);
+    					// Initialize a synchronous disk,
+					// by initializing the raw Disk,
+					// with "cacheSize" cache buffers,
+					// scheduling requests by "policy".
     ~SynchDisk();			// De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
     					// only once the data is actually read 
-					// or written.  These call
-    					// Disk::ReadRequest/WriteRequest and
-					// then wait until the request is done.
+					// or written (into the cache).
     void WriteSector(int sectorNumber, char* data);
+    void ReadSectors(SectorIO *vec, int count);
+    void WriteSectors(SectorIO *vec, int count);
+    					// Same, for several sectors; those
+					// not cached are read from the disk
+					// in a single request
+    void Prefetch(int *sectors, int count);
+    					// Start reading sectors into the
+					// cache, without waiting for them
+
+    char *PinSector(int sectorNumber);	// Update a sector in place in the
+    void UnpinSector(int sectorNumber, bool dirty);	// cache; see
+					// BufferCache::Pin
+    void Flush();			// Write back all modified sectors
+
+    void ReadRaw(SectorIO *vec, int count);
+    void WriteRaw(SectorIO *vec, int count);
+    					// Transfer sectors as one request,
+					// bypassing the cache; only the
+					// cache uses these
     
     void RequestDone();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
   private:
+    void Request(SectorIO *vec, int count, bool writing);
+    					// Queue a request, and wait for it
+    void Start(DiskRequest *req);	// Send a request to the disk
+    DiskRequest *NextRequest();		// Take the next one off the queue
+
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    DiskSched sched;			// Which request goes next
+    DiskRequest *active;		// The request the disk is doing,
+					// or NULL if it is idle
+    DiskRequest *queue;			// Requests waiting, oldest first
+    int headSector;			// Where the last request left the
+					// head
+    int direction;			// SCAN's direction: 1 up, -1 down
+    BufferCache *cache;			// Recently used sectors
 };
 
 #endif // SYNCHDISK_H
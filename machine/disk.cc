@@ -123,42 +123,95 @@ PrintSector (bool writing, int sector, char *data)
 void
 Disk::ReadRequest(int sectorNumber, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    SectorIO io;
 
-
-    ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-    
-    DEBUG('d', "Reading from sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
-    if (DebugIsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
-    
-    active = TRUE;
-    UpdateLast(sectorNumber);
-    stats->numDiskReads++;
-    interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
+    io.sector = sectorNumber;
+    io.data = data;
+    Transfer(&io, 1, FALSE);
 }
 
 void
 Disk::WriteRequest(int sectorNumber, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    SectorIO io;
 
-    ASSERT(!active);
-    //printf("sectorNumber: %d, NumSectors: %d\n",sectorNumber, NumSectors);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-    
-    DEBUG('d', "Writing to sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
-    if (DebugIsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+    io.sector = sectorNumber;
+    io.data = data;
+    Transfer(&io, 1, TRUE);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadSectors/WriteSectors
+// 	Simulate a request to read/write several disk sectors, each to
+//	or from its own buffer, as a single request: there is only one
+//	interrupt, when all of them are done.
+//
+//	"vec" -- the sectors, and their buffers, in the order to transfer
+//	"count" -- how many there are
+//----------------------------------------------------------------------
+
+void
+Disk::ReadSectors(SectorIO *vec, int count)
+{
+    Transfer(vec, count, FALSE);
+}
+
+void
+Disk::WriteSectors(SectorIO *vec, int count)
+{
+    Transfer(vec, count, TRUE);
+}
+
+//----------------------------------------------------------------------
+// Disk::Transfer
+// 	Do the work of a request: read/write each sector immediately to
+//	the UNIX file, adding up how long the disk would take, then set
+//	up the interrupt for when it would be finished.
+//
+//	A sector right after the previous one on the same track is under
+//	the head as soon as the previous one has been transferred, so it
+//	only costs RotationTime; any other pays a seek and rotational
+//	delay, from where the head is by then.
+//----------------------------------------------------------------------
+
+void
+Disk::Transfer(SectorIO *vec, int count, bool writing)
+{
+    int ticks = 0, when, sector;
+
+    ASSERT(!active);				// only one request at a time
+    ASSERT(count > 0);
+    for (int i = 0; i < count; i++) {
+	sector = vec[i].sector;
+	ASSERT((sector >= 0) && (sector < NumSectors));
+
+	when = stats->totalTicks + ticks;
+	if (i > 0 && sector == vec[i - 1].sector + 1 
+		&& (sector % SectorsPerTrack) != 0)
+	    ticks += RotationTime;
+	else {
+	    ticks += Latency(sector, writing, when);
+	    stats->numSeekTracks += abs(sector / SectorsPerTrack 
+					- lastSector / SectorsPerTrack);
+	}
+	UpdateLast(sector, when);
+
+	Lseek(fileno, SectorSize * sector + MagicSize, 0);
+	if (writing) {
+	    DEBUG('d', "Writing to sector %d\n", sector);
+	    WriteFile(fileno, vec[i].data, SectorSize);
+	    stats->numDiskWrites++;
+	} else {
+	    DEBUG('d', "Reading from sector %d\n", sector);
+	    Read(fileno, vec[i].data, SectorSize);
+	    stats->numDiskReads++;
+	}
+	if (DebugIsEnabled('d'))
+	    PrintSector(writing, sector, vec[i].data);
+    }
     
+    DEBUG('d', "Request of %d sectors, latency = %d\n", count, ticks);
     active = TRUE;
-    UpdateLast(sectorNumber);
-    stats->numDiskWrites++;
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
 
@@ -187,13 +240,13 @@ Disk::HandleInterrupt ()
 //----------------------------------------------------------------------
 
 int
-Disk::TimeToSeek(int newSector, int *rotation) 
+Disk::TimeToSeek(int newSector, int *rotation, int when) 
 {
     int newTrack = newSector / SectorsPerTrack;
     int oldTrack = lastSector / SectorsPerTrack;
     int seek = abs(newTrack - oldTrack) * SeekTime;
 				// how long will seek take?
-    int over = (stats->totalTicks + seek) % RotationTime; 
+    int over = (when + seek) % RotationTime; 
 				// will we be in the middle of a sector when
 				// we finish the seek?
 
@@ -287,12 +340,25 @@ Disk::useWriteBuffer(int newSector, bool writing)
 
 int
 Disk::ComputeLatency(int newSector, bool writing)
+{
+    return Latency(newSector, writing, stats->totalTicks);
+}
+
+//----------------------------------------------------------------------
+// Disk::Latency()
+// 	ComputeLatency, for a request that reaches "newSector" at time
+//	"when" -- later than now, for a sector in the middle of a
+//	multi-sector request.
+//----------------------------------------------------------------------
+
+int
+Disk::Latency(int newSector, bool writing, int when)
 {
     if(useWriteBuffer(newSector,writing))
         return checkBufferTime;
     int rotation;
-    int seek = TimeToSeek(newSector, &rotation);
-    int timeAfter = stats->totalTicks + seek + rotation;
+    int seek = TimeToSeek(newSector, &rotation, when);
+    int timeAfter = when + seek + rotation;
 
 #ifndef NOTRACKBUF	// turn this on if you don't want the track buffer stuff
     // check if track buffer applies
@@ -317,13 +383,13 @@ Disk::ComputeLatency(int newSector, bool writing)
 //----------------------------------------------------------------------
 
 void
-Disk::UpdateLast(int newSector)
+Disk::UpdateLast(int newSector, int when)
 {
     int rotate;
-    int seek = TimeToSeek(newSector, &rotate);
+    int seek = TimeToSeek(newSector, &rotate, when);
     
     if (seek != 0)
-	bufferInit = stats->totalTicks + seek + rotate;
+	bufferInit = when + seek + rotate;
     lastSector = newSector;
     DEBUG('d', "Updating last sector = %d, %d\n", lastSector, bufferInit);
 }
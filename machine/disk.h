@@ -46,6 +46,12 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// A request can also cover several sectors, each with its own buffer
+// (scatter/gather).  The head then moves from one sector to the next
+// in the order given; a sector following the previous one on the same
+// track costs only its transfer time.  There is one interrupt, when
+// the last sector is done.
 
 #define SectorSize 		128	// number of bytes per disk sector
 #define SectorsPerTrack 	256	// number of sectors per disk track 
@@ -53,6 +59,15 @@
 #define NumSectors 		(SectorsPerTrack * NumTracks)
 					// total # of sectors per disk
 
+// One sector of a multi-sector request: the sector, and the buffer to
+// read it into or write it from.
+
+class SectorIO {
+  public:
+    int sector;
+    char *data;
+};
+
 class Disk {
   public:
     Disk(char* name, VoidFunctionPtr callWhenDone, int callArg);
@@ -68,6 +83,11 @@ class Disk {
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
 
+    void ReadSectors(SectorIO *vec, int count);
+    void WriteSectors(SectorIO *vec, int count);
+    					// Read/write "count" sectors as a
+					// single request
+
     void HandleInterrupt();		// Interrupt handler, invoked when
 					// disk request finishes.
 
@@ -88,9 +108,15 @@ class Disk {
 					// being loaded
     List* writeBuffer;
 
-    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
+    void Transfer(SectorIO *vec, int count, bool writing);
+    					// Do a request of one or more sectors
+    int Latency(int newSector, bool writing, int when);
+    					// ComputeLatency, for a sector
+					// reached at time "when"
+    int TimeToSeek(int newSector, int *rotate, int when);
+    					// time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
-    void UpdateLast(int newSector);
+    void UpdateLast(int newSector, int when);
 };
 
 #endif // DISK_H
@@ -47,6 +47,7 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
     handler = func;
     arg = param;
     when = time;
+    seq = 0;
     type = kind;
 }
 
@@ -60,7 +61,11 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    maxPending = InitialPending;
+    pending = new PendingInterrupt*[maxPending];
+    numPending = 0;
+    nextSeq = 0;
+    nextDue = NeverDue;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
@@ -73,9 +78,9 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
-    delete pending;
+    for (int i = 0; i < numPending; i++)
+	delete pending[i];
+    delete [] pending;
 }
 
 //----------------------------------------------------------------------
@@ -146,6 +151,9 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	Until the earliest pending interrupt is due, there is nothing to
+//	check, and nothing can have asked for a context switch.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
@@ -161,6 +169,8 @@ Interrupt::OneTick()
 	stats->userTicks += UserTick;
     }
     DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
+    if (stats->totalTicks < nextDue)
+	return;
 
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);		// first, turn off interrupts
@@ -240,10 +250,14 @@ Interrupt::Idle()
 //----------------------------------------------------------------------
 // Interrupt::Halt
 // 	Shut down Nachos cleanly, printing out performance statistics.
+//	Anything still in the disk buffer cache is written back first.
 //----------------------------------------------------------------------
 void
 Interrupt::Halt()
 {
+#ifdef FILESYS
+    synchDisk->Flush();
+#endif
     printf("Machine halting!\n\n");
     stats->Print();
     Cleanup();     // Never returns.
@@ -254,7 +268,8 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on a heap, ordered by when it is due and
+//	then by when it was scheduled.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -275,7 +290,93 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    if (numPending == maxPending) {
+	PendingInterrupt **bigger = new PendingInterrupt*[2 * maxPending];
+
+	for (int i = 0; i < numPending; i++)
+	    bigger[i] = pending[i];
+	delete [] pending;
+	pending = bigger;
+	maxPending *= 2;
+    }
+    toOccur->seq = nextSeq++;
+    pending[numPending] = toOccur;
+    SiftUp(numPending++);
+    nextDue = pending[0]->when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Earlier
+// 	Return TRUE if interrupt "a" is to fire before "b": it is due
+//	earlier, or at the same time but was scheduled first.
+//----------------------------------------------------------------------
+
+bool
+Interrupt::Earlier(PendingInterrupt *a, PendingInterrupt *b)
+{
+    if (a->when != b->when)
+	return a->when < b->when;
+    return (int) (a->seq - b->seq) < 0;	// right even once seq wraps
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SiftUp
+// 	Move pending[i] towards the root of the heap until its parent
+//	is due before it.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SiftUp(int i)
+{
+    PendingInterrupt *item = pending[i];
+
+    while (i > 0 && Earlier(item, pending[(i - 1) / 2])) {
+	pending[i] = pending[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    pending[i] = item;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SiftDown
+// 	Move pending[i] away from the root of the heap until both its
+//	children are due after it.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SiftDown(int i)
+{
+    PendingInterrupt *item = pending[i];
+    int child;
+
+    while ((child = 2 * i + 1) < numPending) {
+	if (child + 1 < numPending && Earlier(pending[child + 1], pending[child]))
+	    child++;
+	if (!Earlier(pending[child], item))
+	    break;
+	pending[i] = pending[child];
+	i = child;
+    }
+    pending[i] = item;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::RemoveFirst
+// 	Take the earliest interrupt off the heap, and return it.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::RemoveFirst()
+{
+    PendingInterrupt *first = pending[0];
+
+    pending[0] = pending[--numPending];
+    if (numPending > 0) {
+	SiftDown(0);
+	nextDue = pending[0]->when;
+    } else
+	nextDue = NeverDue;
+    return first;
 }
 
 //----------------------------------------------------------------------
@@ -300,26 +401,22 @@ Interrupt::CheckIfDue(bool advanceClock)
 					// to invoke an interrupt handler
     if (DebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
-
-    if (toOccur == NULL)		// no pending interrupts
+    if (numPending == 0)		// no pending interrupts
 	return FALSE;			
+    PendingInterrupt *toOccur = pending[0];
+    when = nextDue;
 
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks)	// not time yet, leave it
 	return FALSE;
-    }
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+				&& numPending == 1)
 	 return FALSE;
-    }
+    (void) RemoveFirst();
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 			intTypeNames[toOccur->type], toOccur->when);
@@ -339,6 +436,24 @@ Interrupt::CheckIfDue(bool advanceClock)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Interrupt::NextDueTime
+// 	Find out when the earliest pending interrupt is due, so that the
+//	simulator can tell how many ticks it may run before OneTick has
+//	anything to do.
+//
+// Returns:
+//	FALSE if no interrupt is pending; otherwise TRUE, with the time
+//	stored in "*when".
+//----------------------------------------------------------------------
+
+bool
+Interrupt::NextDueTime(int *when)
+{
+    *when = nextDue;
+    return numPending > 0;
+}
+
 //----------------------------------------------------------------------
 // PrintPending
 // 	Print information about an interrupt that is scheduled to occur.
@@ -357,7 +472,8 @@ PrintPending(int arg)
 //----------------------------------------------------------------------
 // DumpState
 // 	Print the complete interrupt state - the status, and all interrupts
-//	that are scheduled to occur in the future.
+//	that are scheduled to occur in the future, in heap order (the
+//	first is the next to fire).
 //----------------------------------------------------------------------
 
 void
@@ -367,7 +483,8 @@ Interrupt::DumpState()
 					intLevelNames[level]);
     printf("Pending interrupts:\n");
     fflush(stdout);
-    pending->Mapcar(PrintPending);
+    for (int i = 0; i < numPending; i++)
+	PrintPending((int) pending[i]);
     printf("End of pending interrupts\n");
     fflush(stdout);
 }
@@ -20,6 +20,11 @@
 //	simulated time advances (so that it becomes time to invoke an
 //	interrupt in the hardware simulation).
 //
+//	Pending interrupts are kept in a binary heap ordered by when they
+//	are due, so scheduling one is O(log n); the time the earliest one
+//	is due is cached, so that most ticks need only compare the clock
+//	against it.
+//
 //	NOTE: this means that incorrectly synchronized code may work
 //	fine on this hardware simulation (even with randomized time slices),
 //	but it wouldn't work on real hardware.  (Just because we can't
@@ -46,6 +51,10 @@ enum IntStatus { IntOff, IntOn };
 // is empty (IdleMode).
 enum MachineStatus {IdleMode, SystemMode, UserMode};
 
+#define InitialPending	16	// room in the pending interrupt heap; it
+				// grows as needed
+#define NeverDue	0x7fffffff	// nextDue when nothing is pending
+
 // IntType records which hardware device generated an interrupt.
 // In Nachos, we support a hardware timer device, a disk, a console
 // display and keyboard, and a network.
@@ -66,6 +75,8 @@ class PendingInterrupt {
 				// emulator) to call when the interrupt occurs
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
+    unsigned int seq;		// Order in which it was scheduled, so that
+				// interrupts due at once fire in that order
     IntType type;		// for debugging
 };
 
@@ -112,10 +123,17 @@ class Interrupt {
     
     void OneTick();       		// Advance simulated time
 
+    bool NextDueTime(int *when);	// When is the next interrupt due?
+					// FALSE if none is pending
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt **pending;	// heap of the interrupts scheduled to
+				// occur in the future, earliest first
+    int numPending;		// interrupts in the heap
+    int maxPending;		// room in the heap
+    unsigned int nextSeq;	// seq of the next interrupt scheduled
+    int nextDue;		// when pending[0] is due, or NeverDue
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
@@ -128,6 +146,13 @@ class Interrupt {
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
+
+    bool Earlier(PendingInterrupt *a, PendingInterrupt *b);
+					// Should "a" fire before "b"?
+    void SiftUp(int i);			// Restore the heap order after
+    void SiftDown(int i);		// pending[i] has moved
+    PendingInterrupt *RemoveFirst();	// Take the earliest interrupt off
+					// the heap
 };
 
 #endif // INTERRRUPT_H
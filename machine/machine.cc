@@ -18,6 +18,9 @@ static char* exceptionNames[] = { "no exception", "syscall",
                 "page read only", "bus error", "address error", 
                 "overflow",	"illegal instruction" };
 
+// Names of the page replacement policies, as given on the command line.
+char *replacePolicyNames[] = { "lru", "clock", "esc", "wsclock" };
+
 //----------------------------------------------------------------------
 // CheckEndian
 // 	Check to be sure that the host really uses the format it says it 
@@ -50,9 +53,15 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"blocks" -- if TRUE, execute user code with the basic-block
+//		engine instead of one instruction at a time.
+//	"tlbEntries", "tlbAssoc" -- size and associativity of the TLB,
+//		if there is one.  The number of sets must be a power of 2.
+//	"policy" -- how to choose a frame to evict when memory is full.
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool blocks, int tlbEntries, int tlbAssoc,
+		ReplacePolicy policy)
 {
     leftPages = NumPhysPages;
     int i;
@@ -62,6 +71,15 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
+    decodeCache = new DecodedInstruction[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++) {
+        decodeCache[i].valid = FALSE;
+        decodeCache[i].blockLength = 0;
+    }
+    blockEpoch = 0;
+    frameDecoded = new bool[NumPhysPages];
+    for (i = 0; i < NumPhysPages; i++)
+        frameDecoded[i] = FALSE;
     reversePageTable = new TranslationEntry[NumPhysPages];
     for(i = 0; i < NumPhysPages; i++)
     {
@@ -70,25 +88,52 @@ Machine::Machine(bool debug)
         reversePageTable[i].readOnly = FALSE;
         reversePageTable[i].valid = FALSE;
         reversePageTable[i].physicalPage = i;
-        reversePageTable[i].ownerThread = NULL;
+        reversePageTable[i].owner = NULL;
         reversePageTable[i].lastUseTime = 0;
+        reversePageTable[i].next = NULL;
     }
+    pageHash = new TranslationEntry*[PageHashSize];
+    for (i = 0; i < PageHashSize; i++)
+        pageHash[i] = NULL;
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-    {
-        tlb[i].use = FALSE;
+    tlbSize = tlbEntries;
+    tlbWays = tlbAssoc;
+    ASSERT(tlbWays > 0 && tlbSize % tlbWays == 0);
+    tlbSets = tlbSize / tlbWays;
+    ASSERT(tlbSets > 0 && (tlbSets & (tlbSets - 1)) == 0);
+    tlb = new TranslationEntry[tlbSize];
+    tlbNewer = new int[tlbSize];
+    tlbOlder = new int[tlbSize];
+    tlbNewest = new int[tlbSets];
+    tlbOldest = new int[tlbSets];
+    frameTLB = new int[NumPhysPages];
+    tlbNextSame = new int[tlbSize];
+    tlbPrevSame = new int[tlbSize];
+    for (i = 0; i < tlbSize; i++)
         tlb[i].valid = FALSE;
-        tlb[i].dirty = FALSE;
-        tlb[i].readOnly = FALSE;
-    }
+    FlushTLB();
     pageTable = NULL;
 #else	// use linear page table
     tlb = NULL;
+    tlbSize = tlbWays = tlbSets = 0;
     pageTable = NULL;
 #endif
 
+    currentASID = 0;
+    asidGeneration = 1;
+    nextASID = 0;
+    tlbAccesses = 0;
+    replacePolicy = policy;
+    clockHand = 0;
+    pagerWakeup = NULL;
+    frameEvents = 0;
+    frameWaiters = 0;
+    frameWait = NULL;
+    pagerAwake = FALSE;
+    stats->replacePolicy = replacePolicyNames[policy];
+
     singleStep = debug;
+    blockEngine = blocks;
     CheckEndian();
 }
 
@@ -100,9 +145,21 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
+    delete [] decodeCache;
+    delete [] frameDecoded;
     delete [] reversePageTable;
-    if (tlb != NULL)
+    delete [] pageHash;
+    delete frameWait;
+    if (tlb != NULL) {
         delete [] tlb;
+        delete [] tlbNewer;
+        delete [] tlbOlder;
+        delete [] tlbNewest;
+        delete [] tlbOldest;
+        delete [] frameTLB;
+        delete [] tlbNextSame;
+        delete [] tlbPrevSame;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -122,6 +179,7 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
     
 //  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
+    blockEpoch++;			// the kernel may change anything
     DelayedLoad(0, 0);			// finish anything in progress
     interrupt->setStatus(SystemMode);
     ExceptionHandler(which);		// interrupts are enabled at this point
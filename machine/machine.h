@@ -35,6 +35,33 @@
 #define NumPhysPages    256
 #define MemorySize 	(NumPhysPages * PageSize)
 #define TLBSize		32		// if there is a TLB, make it small
+#define TLBWays		4		// default TLB associativity
+#define NumASIDs	64		// address space IDs before the TLB
+					// has to be flushed and IDs reused
+#define InstrsPerPage	(PageSize / 4)	// instruction words in one page
+#define PageHashSize	(2 * NumPhysPages)	// buckets in the inverted
+						// page table hash
+#define WorkingSetWindow 2000		// ticks a page stays in the working
+					// set after its last reference
+#define WSClockMaxCleans 4		// dirty pages WSClock writes back
+					// in one search for a victim
+#define PagerLowWater	(NumPhysPages / 16)	// wake the pager when
+						// fewer frames are free
+#define PagerHighWater	(NumPhysPages / 8)	// the pager stops once
+						// this many are free
+
+// Ways of choosing the frame to evict when physical memory is full.
+
+enum ReplacePolicy { LRUReplace,	// oldest lastUseTime (full scan)
+		     ClockReplace,	// second chance on the use bit
+		     SecondChanceReplace, // enhanced second chance: prefer
+					// unused, then clean, pages
+		     WSClockReplace,	// evict clean pages outside the
+					// working set
+		     NumReplacePolicies
+};
+
+extern char *replacePolicyNames[];	// "lru", "clock", "esc", "wsclock"
 
 
 enum ExceptionType { NoException,           // Everything ok!
@@ -93,6 +120,24 @@ class Instruction {
                      // Immediates are sign-extended.
 };
 
+// The following class defines one slot of the pre-decoded instruction
+// cache.  There is a slot for every aligned word of main memory; a valid
+// slot holds the decoded form of the word currently stored there, so
+// that straight-line code is only decoded once per page load.
+//
+// The basic-block engine (Machine::RunBlock) also keeps its translation
+// here: the slots of a block, in address order, form its array of
+// handlers, and the slot a block is entered at records its length.
+
+class DecodedInstruction {
+  public:
+    Instruction instr;	// the decoded word
+    bool valid;		// TRUE if "instr" matches main memory
+    void *handler;	// code in RunBlock that executes "instr"
+    int blockLength;	// # of instructions in the block starting
+			// here, 0 if no block has been built here
+};
+
 // The following class defines the simulated host workstation hardware, as 
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our 
@@ -107,9 +152,13 @@ class Instruction {
 // translate.cc.
 
 
+class Semaphore;
+
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
+    Machine(bool debug, bool blocks = FALSE, int tlbEntries = TLBSize,
+		int tlbAssoc = TLBWays, ReplacePolicy policy = LRUReplace);
+				// Initialize the simulation of the hardware
 				// for running user programs
     ~Machine();			// De-allocate the data structures
 
@@ -126,16 +175,33 @@ class Machine {
 
     void OneInstruction(Instruction *instr); 	
     				// Run one instruction of a user program.
+    bool ExecuteInstruction(Instruction *instr);
+				// Carry out an already fetched instruction.
+				// Return FALSE if it raised an exception.
+    bool RunBlock();		// Run the basic block at PC, with its ticks.
+				// Return FALSE if PC can't start a block.
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
+    bool FetchInstruction(Instruction *instr);
+				// Fetch and decode the instruction at PC,
+				// using the pre-decoded copy if there is one
+    void InvalidateDecoded(int physPage);
+				// Forget the decoded copies of a frame's words
+    void InvalidateDecodedWord(int physAddr);
+				// Forget the decoded copy of one word
     
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
-    void RefreshSwap();
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
     
+    bool TranslateAccess(int addr, int size, bool writing, int* physAddr);
+				// Translate an address for ReadMem/WriteMem,
+				// trapping to the kernel on a TLB miss or
+				// page fault.  Return FALSE if the access
+				// still failed.
+
     ExceptionType Translate(int virtAddr, int* physAddr, int size, bool writing, bool usePageTable);
     				// Translate an address, and check for 
 				// alignment.  Set the use and dirty bits in 
@@ -151,12 +217,41 @@ class Machine {
     void DumpState();		// print the user CPU and memory state 
 
     void TLBLoad(int virtAddr, TranslationEntry *entry = NULL); // load a tlb entry
-    int FindTLBindex();  // find a tlb index to load tlb
+    int FindTLBindex(int vpn);  // find a tlb index to load tlb
+    int TLBLookup(int vpn, int asid);	// index of the valid tlb entry
+				// for "vpn" in space "asid", or -1; only
+				// searches the set they map to
+    void TLBInvalidate(int index);	// drop one tlb entry
+    void FlushTLB();		// drop every tlb entry
+    int NewASID();		// hand out an address space ID, flushing
+				// the TLB when they run out
 
     void PageLoad(int virtAddr);
-    void PageSwap(int index = -1);
+    bool PageSwap(int index = -1);	// evict a page; FALSE if none was
+    bool EvictFrame(int frame);		// evict the page in "frame"
+    void StartPager();		// fork the page-out daemon
+    void Pager();		// body of the page-out daemon
+    void WakePager();		// wake it if free frames run low
     TranslationEntry* getPyhsPage(int vpn);
     void refreshPage(int index);
+    int FindVictim();		// choose a frame to evict, by replacePolicy
+    void ClearUse(int frame);	// clear the use bit of a frame, and of
+				// its TLB entry
+    void PageWriteBack(int frame);	// write a frame to its swap slot
+				// and mark it clean
+    void FrameReadOnly(int frame, bool readOnly);
+				// set the read-only bit of a frame and
+				// of its TLB entries
+    int AllocFrame();		// take a free frame, evicting if need be
+    void CopyOnWrite(int virtAddr);	// handle a write to a shared page
+
+    TranslationEntry *PageLookup(void *owner, int vpn);
+				// find the frame holding "vpn" of "owner"
+    void PageHashInsert(TranslationEntry *entry);
+    void PageHashRemove(TranslationEntry *entry);
+				// keep the inverted page table hash up to
+				// date as frames are filled and freed
+    void FreeFrame(int frame);	// give up a frame without writing it back
 
 // Data structures -- all of these are accessible to Nachos kernel code.
 // "public" for convenience.
@@ -189,13 +284,66 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int tlbSize;			// number of entries in "tlb"
+    int tlbWays;			// entries per set; set "s" is
+					// tlb[s * tlbWays .. s * tlbWays +
+					// tlbWays - 1]
+    int tlbSets;			// tlbSize / tlbWays, a power of 2
+    int currentASID;			// ID of the running address space;
+					// only TLB entries tagged with it
+					// are used for translation
+    int asidGeneration;			// bumped whenever IDs are recycled;
+					// an ID from an older generation
+					// is no longer valid
+    int tlbAccesses;			// memory accesses translated through
+					// the TLB, for per-space miss rates
 
     TranslationEntry *pageTable;
     TranslationEntry *reversePageTable;
+    TranslationEntry **pageHash;	// reversePageTable entries in use,
+					// chained by hash of (owner, vpn)
     unsigned int pageTableSize;
     int leftPages;
 
+    DecodedInstruction *decodeCache;	// one slot per word of mainMemory
+    bool *frameDecoded;			// TRUE if some slot of the frame
+					// may be valid
+    int blockEpoch;			// bumped on every trap and every
+					// change to decoded code; a running
+					// block stops when this changes
+
   private:
+    void TLBUnlink(int index);	// replacement order within a set:
+    void TLBMakeNewest(int index);	// newest first, victim last
+    void TLBMakeOldest(int index);
+    void TLBWriteBack(int index);	// copy use/dirty bits to the frame
+    int *tlbNewer, *tlbOlder;	// per entry: neighbours in its set's
+				// replacement order, -1 at the ends
+    int *tlbNewest, *tlbOldest;	// per set: ends of that order
+    void TLBMapFrame(int index);	// keep the valid entries mapping
+    void TLBUnmapFrame(int index);	// each frame on a list
+    int *frameTLB;		// per frame: first valid entry mapping
+				// it, or -1
+    int *tlbNextSame, *tlbPrevSame;	// per entry: neighbours mapping the
+				// same frame, -1 at the ends
+    int nextASID;		// next unused ID of this generation
+
+    int FindLRUVictim();	// one per ReplacePolicy
+    int FindClockVictim();
+    int FindSecondChanceVictim();
+    int FindWSClockVictim();
+    ReplacePolicy replacePolicy;
+    int clockHand;		// next frame the clock policies look at
+    Semaphore *pagerWakeup;	// the pager sleeps on this
+    bool pagerAwake;		// TRUE while the pager is refilling
+    void FrameEvent();		// a frame was freed, filled or cleaned
+    void WaitForFrame(int seen);	// sleep until the next FrameEvent,
+				// unless there has been one since "seen"
+    int frameEvents;		// number of FrameEvents so far
+    int frameWaiters;		// threads sleeping on frameWait
+    Semaphore *frameWait;	// they wait here for a FrameEvent
+
+    bool blockEngine;		// run user code a basic block at a time
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
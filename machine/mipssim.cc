@@ -31,12 +31,18 @@ void
 Machine::Run()
 {
     Instruction *instr = new Instruction;  // storage for decoded instruction
+    bool useBlocks = blockEngine && !singleStep && !DebugIsEnabled('m')
+		&& !DebugIsEnabled('a') && !DebugIsEnabled('i');
+				// tracing needs every instruction's fetch
+				// and tick to really happen
 
     if(DebugIsEnabled('m'))
         printf("Starting thread \"%s\" at time %d\n",
 	       currentThread->getName(), stats->totalTicks);
     interrupt->setStatus(UserMode);
     for (;;) {
+	if (useBlocks && RunBlock())
+	    continue;
         OneInstruction(instr);
 	interrupt->OneTick();
 	if (singleStep && (runUntilTime <= stats->totalTicks))
@@ -93,16 +99,9 @@ TypeToReg(RegType reg, Instruction *instr)
 void
 Machine::OneInstruction(Instruction *instr)
 {
-    int raw;
-    int nextLoadReg = 0; 	
-    int nextLoadValue = 0; 	// record delayed load operation, to apply
-				// in the future
-
-    // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
+    // Fetch instruction, already decoded if it was seen before
+    if (!machine->FetchInstruction(instr))
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
 
     if (DebugIsEnabled('m')) {
        struct OpString *str = &opStrings[instr->opCode];
@@ -113,6 +112,26 @@ Machine::OneInstruction(Instruction *instr)
 		TypeToReg(str->args[1], instr), TypeToReg(str->args[2], instr));
        printf("\n");
        }
+
+    (void) ExecuteInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecuteInstruction
+// 	Carry out the instruction "instr", already fetched from the
+//	current PC: update registers and memory, then advance the program
+//	counters.
+//
+//	Returns FALSE, leaving the program counters alone, if the
+//	instruction raised an exception.
+//----------------------------------------------------------------------
+
+bool
+Machine::ExecuteInstruction(Instruction *instr)
+{
+    int nextLoadReg = 0; 	
+    int nextLoadValue = 0; 	// record delayed load operation, to apply
+				// in the future
     
     // Compute next pc, but don't install in case there's an error or branch.
     int pcAfter = registers[NextPCReg] + 4;
@@ -127,7 +146,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
 	    ((registers[instr->rs] ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[instr->rd] = sum;
 	break;
@@ -137,7 +156,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT) &&
 	    ((instr->extra ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[instr->rt] = sum;
 	break;
@@ -232,7 +251,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_LBU:
 	tmp = registers[instr->rs] + instr->extra;
 	if (!machine->ReadMem(tmp, 1, &value))
-	    return;
+	    return FALSE;
 
 	if ((value & 0x80) && (instr->opCode == OP_LB))
 	    value |= 0xffffff00;
@@ -247,10 +266,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[instr->rs] + instr->extra;
 	if (tmp & 0x1) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return FALSE;
 	}
 	if (!machine->ReadMem(tmp, 2, &value))
-	    return;
+	    return FALSE;
 
 	if ((value & 0x8000) && (instr->opCode == OP_LH))
 	    value |= 0xffff0000;
@@ -269,10 +288,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[instr->rs] + instr->extra;
 	if (tmp & 0x3) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return FALSE;
 	}
 	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	    return FALSE;
 	nextLoadReg = instr->rt;
 	nextLoadValue = value;
 	break;
@@ -286,7 +305,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	    return FALSE;
 	if (registers[LoadReg] == instr->rt)
 	    nextLoadValue = registers[LoadValueReg];
 	else
@@ -317,7 +336,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	    return FALSE;
 	if (registers[LoadReg] == instr->rt)
 	    nextLoadValue = registers[LoadValueReg];
 	else
@@ -383,13 +402,13 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SB:
 	if (!machine->WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SH:
 	if (!machine->WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SLL:
@@ -459,7 +478,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
 	    ((registers[instr->rs] ^ diff) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[instr->rd] = diff;
 	break;
@@ -471,7 +490,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SW:
 	if (!machine->WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SWL:	  
@@ -482,7 +501,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	    return FALSE;
 	switch (tmp & 0x3) {
 	  case 0:
 	    value = registers[instr->rt];
@@ -501,7 +520,7 @@ Machine::OneInstruction(Instruction *instr)
 	    break;
 	}
 	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
+	    return FALSE;
 	break;
     	
       case OP_SWR:	  
@@ -512,7 +531,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	    return FALSE;
 	switch (tmp & 0x3) {
 	  case 0:
 	    value = (value & 0xffffff) | (registers[instr->rt] << 24);
@@ -528,12 +547,12 @@ Machine::OneInstruction(Instruction *instr)
 	    break;
 	}
 	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
+	    return FALSE;
 	break;
     	
       case OP_SYSCALL:
 	RaiseException(SyscallException, 0);
-	return; 
+	return FALSE; 
 	
       case OP_XOR:
 	registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
@@ -546,7 +565,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_RES:
       case OP_UNIMP:
 	RaiseException(IllegalInstrException, 0);
-	return;
+	return FALSE;
 	
       default:
 	ASSERT(FALSE);
@@ -562,6 +581,357 @@ Machine::OneInstruction(Instruction *instr)
 						// are jumping into lala-land
     registers[PCReg] = registers[NextPCReg];
     registers[NextPCReg] = pcAfter;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// EndsBlock
+// 	Return TRUE if a basic block must end after an instruction with
+//	the given op code: anything that can transfer control.
+//----------------------------------------------------------------------
+
+static bool
+EndsBlock(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+      case OP_BLTZ: case OP_BGEZ: case OP_BLTZAL: case OP_BGEZAL:
+      case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+      case OP_SYSCALL: case OP_RES: case OP_UNIMP:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Execute the basic block at the current PC, using threaded dispatch
+//	instead of calling OneInstruction and OneTick per instruction.
+//
+//	The first time a block is entered, its pre-decoded slots are
+//	translated: every slot gets the address of the code below that
+//	carries it out, and the entry slot records how many instructions
+//	the block holds.  A block ends after a branch, jump or syscall,
+//	or at the end of the page.  Running it is then one indirect jump
+//	per instruction.  The common instructions have their own code;
+//	the rest go through ExecuteInstruction.
+//
+//	Results are exactly those of the interpreter.  Each instruction
+//	updates registers, memory and delayed loads in the same way, and
+//	the code page is re-translated wherever the interpreter's fetch
+//	could be observed (before anything that can trap, and for the
+//	last instruction), so TLB use bits and LRU stamps match too.
+//	Ticks are charged in bulk while no interrupt can be due.  The
+//	instruction whose tick reaches the next pending interrupt, and
+//	any instruction that trapped to the kernel, goes through OneTick
+//	and ends the block.
+//
+//	Returns FALSE, having done nothing, if the PC is in a branch delay
+//	slot; the caller then uses OneInstruction for it.
+//----------------------------------------------------------------------
+
+bool
+Machine::RunBlock()
+{
+    static void *handlers[MaxOpcode + 1];
+    static bool initialized = FALSE;
+    DecodedInstruction *slot;
+    Instruction *instr;
+    int physAddr, word, last, i;
+    int remaining;		// instructions left in the block
+    int quiet;			// ticks that can pass before an
+				// interrupt is due
+    int charged = 0;		// ticks not yet added to "stats"
+    int executed = 0;
+    int epoch, due;
+    int nextLoadReg, nextLoadValue, pcAfter, tmp, value;
+    unsigned int rs, rt, imm;
+
+    if (!initialized) {
+	for (i = 0; i <= MaxOpcode; i++)
+	    handlers[i] = &&generic;
+	handlers[OP_ADDIU] = &&addiu;
+	handlers[OP_ADDU] = &&addu;
+	handlers[OP_SUBU] = &&subu;
+	handlers[OP_AND] = &&and_;
+	handlers[OP_ANDI] = &&andi;
+	handlers[OP_ORI] = &&ori;
+	handlers[OP_XOR] = &&xor_;
+	handlers[OP_XORI] = &&xori;
+	handlers[OP_NOR] = &&nor;
+	handlers[OP_LUI] = &&lui;
+	handlers[OP_SLL] = &&sll;
+	handlers[OP_SRA] = &&sra;
+	handlers[OP_SRL] = &&srl;
+	handlers[OP_SLT] = &&slt;
+	handlers[OP_SLTI] = &&slti;
+	handlers[OP_SLTU] = &&sltu;
+	handlers[OP_SLTIU] = &&sltiu;
+	handlers[OP_MFHI] = &&mfhi;
+	handlers[OP_MFLO] = &&mflo;
+	handlers[OP_BEQ] = &&beq;
+	handlers[OP_BNE] = &&bne;
+	handlers[OP_BLEZ] = &&blez;
+	handlers[OP_BGTZ] = &&bgtz;
+	handlers[OP_BLTZ] = &&bltz;
+	handlers[OP_BGEZ] = &&bgez;
+	handlers[OP_J] = &&j;
+	handlers[OP_JAL] = &&jal;
+	handlers[OP_JR] = &&jr;
+	handlers[OP_JALR] = &&jalr;
+	handlers[OP_LW] = &&lw;
+	handlers[OP_LB] = &&lb;
+	handlers[OP_LBU] = &&lb;
+	handlers[OP_SW] = &&sw;
+	handlers[OP_SB] = &&sb;
+	initialized = TRUE;
+    }
+
+    if (registers[NextPCReg] != registers[PCReg] + 4)
+	return FALSE;			// in a delay slot
+
+    // Fetch, exactly as the interpreter would
+    if (!TranslateAccess(registers[PCReg], 4, FALSE, &physAddr)) {
+	interrupt->OneTick();		// the failed fetch still costs a tick
+	return TRUE;
+    }
+    slot = &decodeCache[physAddr / 4];
+
+    // Build the block, if this is the first time it is entered
+    if (!slot->valid || slot->blockLength == 0) {
+	word = physAddr / 4;
+	last = (physAddr / PageSize + 1) * InstrsPerPage;
+	for (i = word; i < last; i++) {
+	    DecodedInstruction *s = &decodeCache[i];
+
+	    if (!s->valid) {
+		s->instr.value = WordToHost(*(unsigned int *) &mainMemory[i * 4]);
+		s->instr.Decode();
+		s->valid = TRUE;
+		stats->numDecodeMisses++;
+	    }
+	    ASSERT(s->instr.opCode <= MaxOpcode);
+	    s->handler = handlers[(int) s->instr.opCode];
+	    if (EndsBlock(s->instr.opCode)) {
+		i++;
+		break;
+	    }
+	}
+	frameDecoded[physAddr / PageSize] = TRUE;
+	slot->blockLength = i - word;
+    }
+
+    remaining = slot->blockLength;
+    if (interrupt->NextDueTime(&due))
+	quiet = due - stats->totalTicks - 1;
+    else
+	quiet = remaining;
+    epoch = blockEpoch;
+
+// Catch up with the side effects of fetching the current instruction:
+// charge the ticks run so far, and touch the code page in the TLB.
+// Fetches are counted as TLB accesses when the block ends, not here.
+#define SYNC_FETCH()						\
+    {								\
+	stats->totalTicks += charged * UserTick;		\
+	stats->userTicks += charged * UserTick;			\
+	charged = 0;						\
+	(void) Translate(registers[PCReg], &tmp, 4, FALSE, FALSE); \
+	tlbAccesses--;						\
+    }
+
+    instr = &slot->instr;
+    nextLoadReg = nextLoadValue = 0;
+    pcAfter = registers[NextPCReg] + 4;
+    if (remaining == 1 || quiet <= 0)
+	SYNC_FETCH();
+    goto *slot->handler;
+
+  addiu:
+    registers[instr->rt] = registers[instr->rs] + instr->extra;
+    goto next;
+  addu:
+    registers[instr->rd] = registers[instr->rs] + registers[instr->rt];
+    goto next;
+  subu:
+    registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
+    goto next;
+  and_:
+    registers[instr->rd] = registers[instr->rs] & registers[instr->rt];
+    goto next;
+  andi:
+    registers[instr->rt] = registers[instr->rs] & (instr->extra & 0xffff);
+    goto next;
+  ori:
+    registers[instr->rt] = registers[instr->rs] | (instr->extra & 0xffff);
+    goto next;
+  xor_:
+    registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
+    goto next;
+  xori:
+    registers[instr->rt] = registers[instr->rs] ^ (instr->extra & 0xffff);
+    goto next;
+  nor:
+    registers[instr->rd] = ~(registers[instr->rs] | registers[instr->rt]);
+    goto next;
+  lui:
+    registers[instr->rt] = instr->extra << 16;
+    goto next;
+  sll:
+    registers[instr->rd] = registers[instr->rt] << instr->extra;
+    goto next;
+  sra:
+    registers[instr->rd] = registers[instr->rt] >> instr->extra;
+    goto next;
+  srl:
+    tmp = registers[instr->rt];
+    tmp >>= instr->extra;
+    registers[instr->rd] = tmp;
+    goto next;
+  slt:
+    registers[instr->rd] = (registers[instr->rs] < registers[instr->rt]);
+    goto next;
+  slti:
+    registers[instr->rt] = (registers[instr->rs] < instr->extra);
+    goto next;
+  sltu:
+    rs = registers[instr->rs];
+    rt = registers[instr->rt];
+    registers[instr->rd] = (rs < rt);
+    goto next;
+  sltiu:
+    rs = registers[instr->rs];
+    imm = instr->extra;
+    registers[instr->rt] = (rs < imm);
+    goto next;
+  mfhi:
+    registers[instr->rd] = registers[HiReg];
+    goto next;
+  mflo:
+    registers[instr->rd] = registers[LoReg];
+    goto next;
+
+  beq:
+    if (registers[instr->rs] == registers[instr->rt])
+	pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    goto next;
+  bne:
+    if (registers[instr->rs] != registers[instr->rt])
+	pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    goto next;
+  blez:
+    if (registers[instr->rs] <= 0)
+	pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    goto next;
+  bgtz:
+    if (registers[instr->rs] > 0)
+	pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    goto next;
+  bltz:
+    if (registers[instr->rs] & SIGN_BIT)
+	pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    goto next;
+  bgez:
+    if (!(registers[instr->rs] & SIGN_BIT))
+	pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    goto next;
+  jal:
+    registers[R31] = registers[NextPCReg] + 4;
+  j:
+    pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
+    goto next;
+  jalr:
+    registers[instr->rd] = registers[NextPCReg] + 4;
+  jr:
+    pcAfter = registers[instr->rs];
+    goto next;
+
+  lw:
+    SYNC_FETCH();
+    tmp = registers[instr->rs] + instr->extra;
+    if (tmp & 0x3) {
+	RaiseException(AddressErrorException, tmp);
+	goto fault;
+    }
+    if (!ReadMem(tmp, 4, &value))
+	goto fault;
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    goto next;
+  lb:
+    SYNC_FETCH();
+    tmp = registers[instr->rs] + instr->extra;
+    if (!ReadMem(tmp, 1, &value))
+	goto fault;
+    if ((value & 0x80) && (instr->opCode == OP_LB))
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    goto next;
+  sw:
+    SYNC_FETCH();
+    if (!WriteMem((unsigned) (registers[instr->rs] + instr->extra), 4,
+		registers[instr->rt]))
+	goto fault;
+    goto next;
+  sb:
+    SYNC_FETCH();
+    if (!WriteMem((unsigned) (registers[instr->rs] + instr->extra), 1,
+		registers[instr->rt]))
+	goto fault;
+    goto next;
+
+  generic:
+    SYNC_FETCH();
+    if (!ExecuteInstruction(instr))
+	goto fault;
+    goto retired;
+
+  next:
+    // same as DelayedLoad(nextLoadReg, nextLoadValue)
+    registers[registers[LoadReg]] = registers[LoadValueReg];
+    registers[LoadReg] = nextLoadReg;
+    registers[LoadValueReg] = nextLoadValue;
+    registers[0] = 0;
+    registers[PrevPCReg] = registers[PCReg];
+    registers[PCReg] = registers[NextPCReg];
+    registers[NextPCReg] = pcAfter;
+  retired:
+    executed++;
+    if (blockEpoch != epoch || quiet <= 0)
+	goto tick;			// trapped, or an interrupt is due
+    charged++;
+    quiet--;
+    if (--remaining == 0)
+	goto done;
+    slot++;
+    instr = &slot->instr;
+    nextLoadReg = nextLoadValue = 0;
+    pcAfter = registers[NextPCReg] + 4;
+    if (remaining == 1 || quiet <= 0)
+	SYNC_FETCH();
+    goto *slot->handler;
+
+  fault:
+    tlbAccesses++;			// the faulting instruction was fetched
+  tick:
+    stats->totalTicks += charged * UserTick;
+    stats->userTicks += charged * UserTick;
+    stats->numDecodeHits += executed;
+    tlbAccesses += executed - 1;	// the first fetch was translated
+    interrupt->OneTick();
+    return TRUE;
+
+  done:
+    stats->totalTicks += charged * UserTick;
+    stats->userTicks += charged * UserTick;
+    stats->numDecodeHits += executed;
+    tlbAccesses += executed - 1;
+    return TRUE;
+#undef SYNC_FETCH
 }
 
 //----------------------------------------------------------------------
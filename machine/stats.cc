@@ -20,8 +20,17 @@ Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
+    numCacheHits = numCacheMisses = numCacheWriteBacks = 0;
+    numReadAheads = numReadAheadHits = 0;
+    numDentryHits = numDentryMisses = 0;
+    numDiskRequests = diskQueueDepth = numSeekTracks = 0;
+    diskSched = NULL;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numDecodeHits = numDecodeMisses = 0;
+    numEvictions = numDirtyEvictions = numPageCleans = 0;
+    numPagerEvictions = numCopyOnWrite = numTextShared = 0;
+    replacePolicy = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -36,9 +45,29 @@ Statistics::Print()
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+    printf("Buffer cache: hits %d, misses %d, write-backs %d\n",
+	numCacheHits, numCacheMisses, numCacheWriteBacks);
+    if (numReadAheads > 0)
+	printf("Read-ahead: sectors %d, used %d\n", numReadAheads,
+							numReadAheadHits);
+    if (numDentryHits + numDentryMisses > 0)
+	printf("Dentry cache: hits %d, misses %d\n", numDentryHits,
+							numDentryMisses);
+    if (diskSched != NULL && numDiskRequests > 0)
+	printf("Disk queue (%s): requests %d, average depth %.2f, "
+	    "average seek %.2f tracks\n", diskSched, numDiskRequests,
+	    (double) diskQueueDepth / numDiskRequests,
+	    (double) numSeekTracks / numDiskRequests);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
+    printf("Paging: faults %d, copy-on-write %d, shared text %d\n",
+	numPageFaults, numCopyOnWrite, numTextShared);
+    if (replacePolicy != NULL)
+	printf("Replacement (%s): evictions %d (%d by pager), dirty %d, "
+	    "cleaned %d\n", replacePolicy, numEvictions, numPagerEvictions,
+	    numDirtyEvictions, numPageCleans);
+    printf("Decode cache: hits %d, misses %d\n", numDecodeHits,
+	numDecodeMisses);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
 }
@@ -30,11 +30,36 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numCacheHits;		// sectors found in the buffer cache
+    int numCacheMisses;		// sectors that had to be read in
+    int numCacheWriteBacks;	// dirty buffers written to disk
+    int numReadAheads;		// sectors read in before being asked for
+    int numReadAheadHits;	// of those, sectors then asked for
+    int numDentryHits;		// names found in the dentry cache
+    int numDentryMisses;	// names that had to be read from directories
+    int numDiskRequests;	// requests sent to the disk driver
+    int diskQueueDepth;		// sum over them of the requests ahead
+				// of each one when it arrived
+    int numSeekTracks;		// tracks the disk head moved across
+    char *diskSched;		// name of the disk scheduling policy,
+				// or NULL if there is no disk
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numEvictions;		// pages evicted to make room
+    int numDirtyEvictions;	// ... of which had to be written back
+    int numPagerEvictions;	// ... made by the page-out daemon
+    int numCopyOnWrite;		// shared pages copied on a write
+    int numTextShared;		// code pages found already mapped by
+				// another run of the same program
+    int numPageCleans;		// dirty pages written back ahead of
+				// eviction
+    char *replacePolicy;	// name of the page replacement policy,
+				// or NULL if there is no paging
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numDecodeHits;		// instruction fetches served pre-decoded
+    int numDecodeMisses;	// instruction fetches that had to decode
 
     Statistics(); 		// initialize everything to zero
 
@@ -72,40 +72,37 @@ ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
 
 
 //----------------------------------------------------------------------
-// Machine::ReadMem
-//      Read "size" (1, 2, or 4) bytes of virtual memory at "addr" into 
-//	the location pointed to by "value".
+// Machine::TranslateAccess
+//      Translate "addr" for a memory access by the simulated CPU.  A TLB
+//	miss is resolved from the inverted page table, and a page that
+//	is not resident is first brought in by trapping to the kernel.
 //
-//   	Returns FALSE if the translation step from virtual to physical memory
-//   	failed.
+//   	Returns FALSE if the translation could not be completed (the
+//	exception has already been raised).
 //
-//	"addr" -- the virtual address to read from
-//	"size" -- the number of bytes to read (1, 2, or 4)
-//	"value" -- the place to write the result
+//	"addr" -- the virtual address being accessed
+//	"size" -- the number of bytes accessed (1, 2, or 4)
+//	"writing" -- TRUE if the access is a store
+//	"physAddr" -- the place to store the physical address
 //----------------------------------------------------------------------
 
 bool
-Machine::ReadMem(int addr, int size, int *value)
+Machine::TranslateAccess(int addr, int size, bool writing, int *physAddr)
 {
-    int data;
     ExceptionType exception;
-    int physicalAddress;
-    
-    DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
-    
-    exception = Translate(addr, &physicalAddress, size, FALSE, FALSE);
+
+    exception = Translate(addr, physAddr, size, writing, FALSE);
     if(exception == TLBMissException)
     {
-    	//machine->RaiseException(exception, addr);
     	DEBUG('a', "find VA 0x%x in pagrtable\n", addr, size);
-    	exception = Translate(addr, &physicalAddress, size, FALSE, TRUE);
+    	exception = Translate(addr, physAddr, size, writing, TRUE);
     	bool PageFaultOccur = FALSE;
     	if(exception == PageFaultException)
     	{
     		PageFaultOccur = TRUE;
     		DEBUG('a', "load VA 0x%x into memory\n", addr, size);
-    		machine->RaiseException(exception, addr);
-    		exception = Translate(addr, &physicalAddress, size, FALSE, TRUE);
+    		machine->RaiseException(exception, addr);	// load page
+    		exception = Translate(addr, physAddr, size, writing, TRUE);
     		if (exception != NoException) {
 				machine->RaiseException(exception, addr);
 				return FALSE;
@@ -122,6 +119,32 @@ Machine::ReadMem(int addr, int size, int *value)
 		machine->RaiseException(exception, addr);
 		return FALSE;
     }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::ReadMem
+//      Read "size" (1, 2, or 4) bytes of virtual memory at "addr" into 
+//	the location pointed to by "value".
+//
+//   	Returns FALSE if the translation step from virtual to physical memory
+//   	failed.
+//
+//	"addr" -- the virtual address to read from
+//	"size" -- the number of bytes to read (1, 2, or 4)
+//	"value" -- the place to write the result
+//----------------------------------------------------------------------
+
+bool
+Machine::ReadMem(int addr, int size, int *value)
+{
+    int data;
+    int physicalAddress;
+    
+    DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
+    
+    if (!TranslateAccess(addr, size, FALSE, &physicalAddress))
+	return FALSE;
     switch (size) {
       case 1:
 	data = machine->mainMemory[physicalAddress];
@@ -148,7 +171,8 @@ Machine::ReadMem(int addr, int size, int *value)
 //----------------------------------------------------------------------
 // Machine::WriteMem
 //      Write "size" (1, 2, or 4) bytes of the contents of "value" into
-//	virtual memory at location "addr".
+//	virtual memory at location "addr".  If the word written has a
+//	pre-decoded copy, the copy is dropped.
 //
 //   	Returns FALSE if the translation step from virtual to physical memory
 //   	failed.
@@ -161,36 +185,12 @@ Machine::ReadMem(int addr, int size, int *value)
 bool
 Machine::WriteMem(int addr, int size, int value)
 {
-    ExceptionType exception;
     int physicalAddress;
      
     DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE, FALSE);
-    if(exception == TLBMissException) // TLB Miss
-    {
-    	exception = Translate(addr, &physicalAddress, size, TRUE, TRUE);
-    	bool PageFaultOccur = FALSE;
-    	if(exception == PageFaultException)
-    	{
-    		PageFaultOccur = TRUE;
-    		machine->RaiseException(exception, addr); // load page
-    		exception = Translate(addr, &physicalAddress, size, TRUE, TRUE);
-    		if (exception != NoException) {
-				machine->RaiseException(exception, addr);
-				return FALSE;
-    		}
-    	}
-    	else if (exception != NoException) {
-			machine->RaiseException(exception, addr);
-			return FALSE;
-    	}
-    	if(!PageFaultOccur)
-    		machine->RaiseException(TLBMissException, addr);
-    }else if (exception != NoException) {
-	machine->RaiseException(exception, addr);
+    if (!TranslateAccess(addr, size, TRUE, &physicalAddress))
 	return FALSE;
-    }
     switch (size) {
       case 1:
 	machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
@@ -208,10 +208,89 @@ Machine::WriteMem(int addr, int size, int value)
 	
       default: ASSERT(FALSE);
     }
+    if (frameDecoded[physicalAddress / PageSize])
+	InvalidateDecodedWord(physicalAddress);
     
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+//      Fetch the instruction at the current PC into "instr", decoded.
+//	The PC is translated exactly as ReadMem would, so TLB and page
+//	replacement see the same reference stream; only the decode step
+//	is skipped when the word already has a valid pre-decoded copy.
+//
+//   	Returns FALSE if the translation step failed.
+//----------------------------------------------------------------------
+
+bool
+Machine::FetchInstruction(Instruction *instr)
+{
+    int physicalAddress;
+    DecodedInstruction *slot;
+
+    DEBUG('a', "Reading VA 0x%x, size %d\n", registers[PCReg], 4);
+
+    if (!TranslateAccess(registers[PCReg], 4, FALSE, &physicalAddress))
+	return FALSE;
+    slot = &decodeCache[physicalAddress / 4];
+    if (slot->valid) {
+	stats->numDecodeHits++;
+    } else {
+	slot->instr.value = 
+		WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+	slot->instr.Decode();
+	slot->valid = TRUE;
+	frameDecoded[physicalAddress / PageSize] = TRUE;
+	stats->numDecodeMisses++;
+    }
+    *instr = slot->instr;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecoded
+//      Throw away the pre-decoded copies of every word in a frame.
+//	Called whenever the frame is refilled or given up.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecoded(int physPage)
+{
+    if (!frameDecoded[physPage])
+	return;
+    for (int i = 0; i < InstrsPerPage; i++) {
+	decodeCache[physPage * InstrsPerPage + i].valid = FALSE;
+	decodeCache[physPage * InstrsPerPage + i].blockLength = 0;
+    }
+    frameDecoded[physPage] = FALSE;
+    blockEpoch++;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedWord
+//      Throw away the pre-decoded copy of the word at "physAddr", after
+//	a store into it.  Any block built earlier in the page that runs
+//	through the word has to be rebuilt too.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecodedWord(int physAddr)
+{
+    int word = physAddr / 4;
+    int first = (physAddr / PageSize) * InstrsPerPage;
+
+    if (!decodeCache[word].valid)
+	return;
+    decodeCache[word].valid = FALSE;
+    decodeCache[word].blockLength = 0;
+    for (int i = first; i < word; i++)
+	if (i + decodeCache[i].blockLength > word)
+	    decodeCache[i].blockLength = 0;
+    blockEpoch++;
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -230,34 +309,394 @@ Machine::WriteMem(int addr, int size, int value)
 TranslationEntry*
 Machine::getPyhsPage(int vpn)
 {
-	TranslationEntry* entry = NULL;
-	for(int i = 0; i < NumPhysPages; i++)
+	return PageLookup(currentThread->space->pages[vpn], vpn);
+}
+
+//----------------------------------------------------------------------
+// PageHashIndex
+// 	Hash an (owner, virtual page) pair to a bucket of the inverted
+//	page table.
+//----------------------------------------------------------------------
+
+static int
+PageHashIndex(void *owner, int vpn)
+{
+	unsigned long key = ((unsigned long) owner >> 3) * 2654435761UL;
+
+	return (int) ((key + (unsigned) vpn) % PageHashSize);
+}
+
+//----------------------------------------------------------------------
+// Machine::PageLookup
+// 	Find the frame that holds virtual page "vpn" of "owner", by
+//	hashing into the inverted page table.  Returns NULL if the page
+//	is not in memory.
+//----------------------------------------------------------------------
+
+TranslationEntry*
+Machine::PageLookup(void *owner, int vpn)
+{
+	TranslationEntry *entry;
+
+	for(entry = pageHash[PageHashIndex(owner, vpn)]; entry != NULL;
+			entry = entry->next)
 	{
-		if(reversePageTable[i].valid &&
-			reversePageTable[i].ownerThread == (void*) currentThread &&
-			reversePageTable[i].virtualPage == vpn)
+		if(entry->owner == owner && entry->virtualPage == vpn)
+			return entry;
+	}
+	return NULL;
+}
+
+//----------------------------------------------------------------------
+// Machine::PageHashInsert
+// 	Make a newly filled frame visible to PageLookup.  The entry's
+//	owner and virtual page must already be set.
+//----------------------------------------------------------------------
+
+void
+Machine::PageHashInsert(TranslationEntry *entry)
+{
+	int bucket = PageHashIndex(entry->owner, entry->virtualPage);
+
+	entry->next = pageHash[bucket];
+	pageHash[bucket] = entry;
+	FrameEvent();			// the frame can be evicted now
+}
+
+//----------------------------------------------------------------------
+// Machine::PageHashRemove
+// 	Take a frame that is being freed out of its hash chain.
+//----------------------------------------------------------------------
+
+void
+Machine::PageHashRemove(TranslationEntry *entry)
+{
+	TranslationEntry **ptr = 
+		&pageHash[PageHashIndex(entry->owner, entry->virtualPage)];
+
+	for(; *ptr != NULL; ptr = &(*ptr)->next)
+	{
+		if(*ptr == entry)
 		{
-			entry = &reversePageTable[i];
+			*ptr = entry->next;
+			entry->next = NULL;
+			return;
 		}
 	}
-	return entry;
 }
 
+//----------------------------------------------------------------------
+// Machine::FreeFrame
+// 	Release a frame: drop it from the inverted page table and the TLB,
+//	and mark it free in pageMap.  The contents are thrown away.
+//----------------------------------------------------------------------
+
+void
+Machine::FreeFrame(int frame)
+{
+	TranslationEntry *entry = &reversePageTable[frame];
+
+	if(tlb != NULL)
+		while(frameTLB[frame] >= 0)
+			TLBInvalidate(frameTLB[frame]);
+	if(entry->valid)
+		PageHashRemove(entry);
+	entry->valid = FALSE;
+	entry->dirty = FALSE;
+	pageMap->Clear(frame);
+	InvalidateDecoded(frame);
+	FrameEvent();
+}
+
+//----------------------------------------------------------------------
+// Machine::refreshPage
+// 	Bring the use and dirty bits of frame "index" up to date with the
+//	TLB entries mapping it.  A shared frame may be in the TLB once for
+//	each address space using it; only those entries are looked at.
+//----------------------------------------------------------------------
+
 void Machine::refreshPage(int index)
 {
 	TranslationEntry *entry = &reversePageTable[index];
-	if(entry->ownerThread != (void*)currentThread)
+
+	if(tlb == NULL)
 		return;
-	for(int i = 0; i < TLBSize; i++)
+	for(int i = frameTLB[index]; i >= 0; i = tlbNextSame[i])
 	{
-		if(tlb[i].virtualPage == entry->virtualPage)
-		{
-			if(!entry->dirty)
-				entry->dirty = tlb[i].dirty;
-			entry->use = tlb[i].use;
+		if(tlb[i].dirty)
+			entry->dirty = TRUE;
+		if(tlb[i].use)
+			entry->use = TRUE;
+		if(tlb[i].lastUseTime > entry->lastUseTime)
 			entry->lastUseTime = tlb[i].lastUseTime;
-			entry->readOnly = tlb[i].readOnly;
-		}
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::ClearUse
+// 	Clear the use bit of "frame", so a later reference to the page
+//	can be noticed.  The TLB entries mapping it are cleared too,
+//	since that is where the hardware sets the bit.
+//----------------------------------------------------------------------
+
+void Machine::ClearUse(int frame)
+{
+	reversePageTable[frame].use = FALSE;
+	if(tlb == NULL)
+		return;
+	for(int i = frameTLB[frame]; i >= 0; i = tlbNextSame[i])
+		tlb[i].use = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Machine::FrameReadOnly
+// 	Allow or forbid writes to "frame", in every TLB entry mapping it
+//	as well.
+//----------------------------------------------------------------------
+
+void Machine::FrameReadOnly(int frame, bool readOnly)
+{
+	reversePageTable[frame].readOnly = readOnly;
+	if(tlb == NULL)
+		return;
+	for(int i = frameTLB[frame]; i >= 0; i = tlbNextSame[i])
+		tlb[i].readOnly = readOnly;
+}
+
+//----------------------------------------------------------------------
+// Machine::PageWriteBack
+// 	Write "frame" to the swap slot backing it, and mark it clean, in
+//	the TLB as well.  The caller must have called refreshPage first.
+//
+//	The page is marked clean before the write, which can block; if
+//	it is written to meanwhile, it is dirty again afterwards.
+//----------------------------------------------------------------------
+
+void Machine::PageWriteBack(int frame)
+{
+	TranslationEntry *entry = &reversePageTable[frame];
+	SwapPage *page = (SwapPage*) entry->owner;
+
+	DEBUG('a', "write back frame %d\n", frame);
+	entry->dirty = FALSE;
+	if(tlb != NULL)
+		for(int i = frameTLB[frame]; i >= 0; i = tlbNextSame[i])
+			tlb[i].dirty = FALSE;
+	page->Write(&mainMemory[frame * PageSize]);
+	FrameEvent();
+}
+
+//----------------------------------------------------------------------
+// TLBSet
+// 	The TLB set holding page "vpn" of address space "asid".  The ID
+//	is mixed in so that the low pages every program uses do not all
+//	compete for the same set.
+//----------------------------------------------------------------------
+
+static inline int
+TLBSet(int vpn, int asid, int sets)
+{
+	return (vpn + asid * 5) & (sets - 1);
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBLookup
+// 	Find the valid TLB entry translating "vpn" for the address space
+//	with ID "asid".  Only the set they map to is searched, so this
+//	takes tlbWays steps at most.
+//
+// Returns:
+//	The index of the entry in "tlb", or -1 on a TLB miss.
+//----------------------------------------------------------------------
+
+int
+Machine::TLBLookup(int vpn, int asid)
+{
+	int first = TLBSet(vpn, asid, tlbSets) * tlbWays;
+
+	for(int i = first; i < first + tlbWays; i++)
+	{
+		if(tlb[i].valid && tlb[i].virtualPage == vpn && tlb[i].asid == asid)
+			return i;
+	}
+	return -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::NewASID
+// 	Hand out an address space ID of the current generation.  When
+//	all NumASIDs have been used the TLB is flushed and a new
+//	generation begins; spaces holding an ID of an older generation
+//	get a fresh one the next time they are switched in.
+//----------------------------------------------------------------------
+
+int
+Machine::NewASID()
+{
+	if(nextASID == NumASIDs)
+	{
+		DEBUG('a', "address space IDs exhausted, flushing TLB\n");
+		FlushTLB();
+		asidGeneration++;
+		nextASID = 0;
+	}
+	return nextASID++;
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBWriteBack
+// 	Copy the use and dirty bits of a valid TLB entry back to the frame
+//	it maps.  Entries are dropped whenever their frame is freed, so
+//	the frame still holds the page.
+//----------------------------------------------------------------------
+
+void
+Machine::TLBWriteBack(int index)
+{
+	TranslationEntry *entry = &reversePageTable[tlb[index].physicalPage];
+
+	if(entry->valid && entry->virtualPage == tlb[index].virtualPage)
+	{
+		if(tlb[index].dirty)
+			entry->dirty = TRUE;
+		if(tlb[index].use)
+			entry->use = TRUE;
+		if(tlb[index].lastUseTime > entry->lastUseTime)
+			entry->lastUseTime = tlb[index].lastUseTime;
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBUnlink, TLBMakeNewest, TLBMakeOldest
+// 	Maintain the replacement order of a TLB set: a doubly linked list
+//	through tlbNewer/tlbOlder, from tlbNewest[set] to tlbOldest[set].
+//	The victim for the next load into a set is always its oldest
+//	entry, so invalid entries are kept at that end.  Under TLB_LRU
+//	an entry is made newest on every hit; otherwise only when it is
+//	loaded, giving FIFO order.
+//----------------------------------------------------------------------
+
+void
+Machine::TLBUnlink(int index)
+{
+	int set = index / tlbWays;
+
+	if(tlbNewer[index] >= 0)
+		tlbOlder[tlbNewer[index]] = tlbOlder[index];
+	else
+		tlbNewest[set] = tlbOlder[index];
+	if(tlbOlder[index] >= 0)
+		tlbNewer[tlbOlder[index]] = tlbNewer[index];
+	else
+		tlbOldest[set] = tlbNewer[index];
+}
+
+void
+Machine::TLBMakeNewest(int index)
+{
+	int set = index / tlbWays;
+
+	if(tlbNewest[set] == index)
+		return;
+	TLBUnlink(index);
+	tlbNewer[index] = -1;
+	tlbOlder[index] = tlbNewest[set];
+	tlbNewer[tlbNewest[set]] = index;
+	tlbNewest[set] = index;
+}
+
+void
+Machine::TLBMakeOldest(int index)
+{
+	int set = index / tlbWays;
+
+	if(tlbOldest[set] == index)
+		return;
+	TLBUnlink(index);
+	tlbOlder[index] = -1;
+	tlbNewer[index] = tlbOldest[set];
+	tlbOlder[tlbOldest[set]] = index;
+	tlbOldest[set] = index;
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBMapFrame, TLBUnmapFrame
+// 	Maintain, for each frame, a doubly linked list through
+//	tlbNextSame/tlbPrevSame of the valid TLB entries mapping it,
+//	starting at frameTLB[frame].  A shared frame can be mapped once
+//	for each address space using it; the list lets the frame's
+//	entries be found without searching the whole TLB.
+//----------------------------------------------------------------------
+
+void
+Machine::TLBMapFrame(int index)
+{
+	int frame = tlb[index].physicalPage;
+
+	tlbPrevSame[index] = -1;
+	tlbNextSame[index] = frameTLB[frame];
+	if(frameTLB[frame] >= 0)
+		tlbPrevSame[frameTLB[frame]] = index;
+	frameTLB[frame] = index;
+}
+
+void
+Machine::TLBUnmapFrame(int index)
+{
+	if(tlbPrevSame[index] >= 0)
+		tlbNextSame[tlbPrevSame[index]] = tlbNextSame[index];
+	else
+		frameTLB[tlb[index].physicalPage] = tlbNextSame[index];
+	if(tlbNextSame[index] >= 0)
+		tlbPrevSame[tlbNextSame[index]] = tlbPrevSame[index];
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBInvalidate
+// 	Drop one TLB entry, making it the first to be reused in its set.
+//----------------------------------------------------------------------
+
+void
+Machine::TLBInvalidate(int index)
+{
+	if(tlb[index].valid)
+	{
+		TLBWriteBack(index);
+		TLBUnmapFrame(index);
+	}
+	tlb[index].valid = FALSE;
+	tlb[index].dirty = FALSE;
+	tlb[index].readOnly = FALSE;
+	TLBMakeOldest(index);
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTLB
+// 	Invalidate the whole TLB and reset the replacement order.  This
+//	is only needed when address space IDs are recycled.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTLB()
+{
+	for(int i = 0; i < tlbSize; i++)
+	{
+		if(tlb[i].valid)
+			TLBWriteBack(i);
+		tlb[i].use = FALSE;
+		tlb[i].valid = FALSE;
+		tlb[i].dirty = FALSE;
+		tlb[i].readOnly = FALSE;
+		tlb[i].lastUseTime = 0;
+		tlbNewer[i] = (i % tlbWays == 0) ? -1 : i - 1;
+		tlbOlder[i] = (i % tlbWays == tlbWays - 1) ? -1 : i + 1;
+	}
+	for(int frame = 0; frame < NumPhysPages; frame++)
+		frameTLB[frame] = -1;
+	for(int set = 0; set < tlbSets; set++)
+	{
+		tlbNewest[set] = set * tlbWays;
+		tlbOldest[set] = set * tlbWays + tlbWays - 1;
 	}
 }
 
@@ -288,6 +727,11 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing, bool use
     
     if (usePageTable) 
     {		// => page table => vpn is index into table
+		if (vpn >= (unsigned) currentThread->space->getNumPages())
+		{
+			DEBUG('a', "virtual page # %d too large!\n", virtAddr);
+			return AddressErrorException;
+		}
 		entry = getPyhsPage(vpn);
 		if(entry == NULL)
 		{
@@ -295,27 +739,13 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing, bool use
 	    	return PageFaultException;		
 		}
 		entry->use = TRUE;
-		if(writing)
-			entry->dirty = TRUE;
 		entry->lastUseTime = stats->totalTicks;
     } 
     else 
     {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-        {
-    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) 
-    	    {
-				entry = &tlb[i];			// FOUND!
-			#ifdef TLB_LRU
-				tlb[i].use = true;
-				tlb[i].lastUseTime = stats->totalTicks;
-			#endif
-				if(writing)
-					tlb[i].dirty = TRUE;
-				break;
-		    }
-		}
-		if (entry == NULL) 
+        i = TLBLookup(vpn, currentASID);
+		tlbAccesses++;
+		if (i < 0) 
 		{				// not found
 	    	DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
 	    	return TLBMissException;		
@@ -323,6 +753,12 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing, bool use
 							// the page may be in memory,
 							// but not in the TLB
 		}
+		entry = &tlb[i];			// FOUND!
+	#ifdef TLB_LRU
+		tlb[i].use = true;
+		tlb[i].lastUseTime = stats->totalTicks;
+		TLBMakeNewest(i);
+	#endif
     }
 
     if (entry->readOnly && writing)
@@ -342,17 +778,11 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing, bool use
     entry->use = TRUE;		// set the use, dirty bits
     if (writing)
 		entry->dirty = TRUE;
-	if(usePageTable)
+	if(usePageTable && tlb != NULL && (i = TLBLookup(vpn, currentASID)) >= 0)
 	{
-		for(int i = 0; i < TLBSize; i++)
-		{
-			if (tlb[i].valid && (tlb[i].virtualPage == vpn)) 
-			{
-				tlb[i].dirty = entry->dirty;
-				tlb[i].use = entry->use;
-				tlb[i].lastUseTime = entry->lastUseTime;
-			}
-		}
+		tlb[i].dirty = entry->dirty;
+		tlb[i].use = entry->use;
+		tlb[i].lastUseTime = entry->lastUseTime;
 	}
     *physAddr = pageFrame * PageSize + offset;
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
@@ -361,172 +791,492 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing, bool use
 }
 
 
+//----------------------------------------------------------------------
+// Machine::TLBLoad
+// 	Load the translation for the page containing "virtAddr" (or the
+//	frame "entry", if given) into the TLB, replacing the oldest entry
+//	of its set.
+//----------------------------------------------------------------------
+
 void Machine::TLBLoad(int virtAddr, TranslationEntry *entry = NULL)
 {
 	int vpn = (unsigned) virtAddr / PageSize;
 
 	if(entry == NULL)
 		entry = getPyhsPage(vpn);
+	else
+		vpn = entry->virtualPage;
 
-	int tlbindex = FindTLBindex();
+	int tlbindex = FindTLBindex(vpn);
 	tlb[tlbindex].virtualPage = entry->virtualPage;
 	tlb[tlbindex].physicalPage = entry->physicalPage;
 	tlb[tlbindex].valid = entry->valid;
 	tlb[tlbindex].readOnly = entry->readOnly;
 	tlb[tlbindex].use = entry->use; 
 	tlb[tlbindex].dirty = entry->dirty;
+	tlb[tlbindex].asid = currentASID;
+	tlb[tlbindex].lastUseTime = stats->totalTicks;
+	if(tlb[tlbindex].valid)
+		TLBMapFrame(tlbindex);
+	TLBMakeNewest(tlbindex);
 }
 
-int Machine::FindTLBindex()
+//----------------------------------------------------------------------
+// Machine::FindTLBindex
+// 	Choose the TLB entry to load "vpn" of the running space into: the
+//	oldest entry of the set they map to.  If it holds a translation,
+//	possibly of another space, its use and dirty bits are first copied
+//	back to the frame it maps.
+//----------------------------------------------------------------------
+
+int Machine::FindTLBindex(int vpn)
 {
-	int index = -1;
-	for(int i = 0; i < TLBSize; i++)
+	int index = tlbOldest[TLBSet(vpn, currentASID, tlbSets)];
+
+	if(tlb[index].valid)
 	{
-		if(!tlb[i].valid)
-		{
-			index = i;
-		}
+		DEBUG('a', "replace tlb entry %d\n", index);
+		TLBWriteBack(index);
+		TLBUnmapFrame(index);
+		tlb[index].valid = FALSE;
 	}
-#ifdef TLB_FIFO
-	if(index == -1)
+	return index;
+}
+
+
+//----------------------------------------------------------------------
+// Machine::FindVictim
+// 	Choose the frame to evict when physical memory is full, using the
+//	policy selected at startup.  The frame returned is valid and its
+//	use/dirty bits are up to date.  Returns -1 if no frame holds a
+//	page (they are all still being loaded).
+//----------------------------------------------------------------------
+
+int Machine::FindVictim()
+{
+	switch(replacePolicy)
 	{
-		DEBUG('a', "replace a tlb entry by FIFO");
-		index = (int)currentThread->space->TLBFIFO_List->Remove();
+	  case ClockReplace:
+		return FindClockVictim();
+	  case SecondChanceReplace:
+		return FindSecondChanceVictim();
+	  case WSClockReplace:
+		return FindWSClockVictim();
+	  default:
+		return FindLRUVictim();
 	}
-	currentThread->space->TLBFIFO_List->Append((void*)index);
-#endif
-#ifdef TLB_LRU
-	int lastedtime = tlb[0].lastUseTime;
-	if(index == -1)
+}
+
+//----------------------------------------------------------------------
+// Machine::FindLRUVictim
+// 	The frame with the oldest lastUseTime.  Looks at every frame.
+//----------------------------------------------------------------------
+
+int Machine::FindLRUVictim()
+{
+	int index = -1;
+	int lastedtime = -1;
+
+	for(int i = 0; i < NumPhysPages; i++)
 	{
-		DEBUG('a', "replace a tlb entry by LRU");
-		index = 0;
-		for(int i = 1; i < TLBSize; i++)
+		if(reversePageTable[i].valid)
 		{
-			if(tlb[i].use && tlb[i].lastUseTime < lastedtime)
+			refreshPage(i);
+			if(lastedtime < 0 ||
+				reversePageTable[i].lastUseTime < lastedtime)
 			{
-				lastedtime = tlb[i].lastUseTime;
 				index = i;
+				lastedtime = reversePageTable[i].lastUseTime;
 			}
 		}
 	}
-	tlb[index].use = true;
-	tlb[index].lastUseTime = stats->totalTicks;
-#endif
-	TranslationEntry *entry = getPyhsPage(tlb[index].virtualPage);
-	if(entry != NULL)
+	return index;
+}
+
+//----------------------------------------------------------------------
+// Machine::FindClockVictim
+// 	Advance the clock hand to the first frame whose use bit is clear,
+//	clearing the use bits it passes.  Two sweeps at most.
+//----------------------------------------------------------------------
+
+int Machine::FindClockVictim()
+{
+	for(int n = 0; n <= 2 * NumPhysPages; n++)
 	{
-		if(!entry->dirty)
-			entry->dirty = tlb[index].dirty;
-		entry->use = tlb[index].use;
-		entry->lastUseTime = tlb[index].lastUseTime;
-		entry->readOnly = tlb[index].readOnly;
+		int frame = clockHand;
+		clockHand = (clockHand + 1) % NumPhysPages;
+		if(!reversePageTable[frame].valid)
+			continue;
+		refreshPage(frame);
+		if(!reversePageTable[frame].use)
+			return frame;
+		ClearUse(frame);
 	}
-	return index;
+	return -1;
 }
 
+//----------------------------------------------------------------------
+// Machine::FindSecondChanceVictim
+// 	Enhanced second chance: sweep for a frame that is neither used
+//	nor dirty; failing that, sweep for one that is unused but dirty,
+//	clearing use bits along the way; then repeat both, since every
+//	use bit is clear by then.  Four sweeps at most.
+//----------------------------------------------------------------------
 
-void Machine::PageSwap(int index = -1)
+int Machine::FindSecondChanceVictim()
 {
-	//int index = -1;
-	if(index == -1)
+	for(int pass = 0; pass < 4; pass++)
 	{
-		int lastedtime = -1;
-		for(int i = 0; i < NumPhysPages; i++)
+		for(int n = 0; n < NumPhysPages; n++)
 		{
-			if(reversePageTable[i].valid)
+			int frame = clockHand;
+			TranslationEntry *entry = &reversePageTable[frame];
+			clockHand = (clockHand + 1) % NumPhysPages;
+			if(!entry->valid)
+				continue;
+			refreshPage(frame);
+			if(!entry->use && !entry->dirty)
+				return frame;
+			if(pass % 2 == 1)
 			{
-				refreshPage(index);
-				if(lastedtime < 0)
-				{
-					lastedtime = reversePageTable[i].lastUseTime;
-					index = i;
-					continue;
-				}
-				//printf("%d : %d, %d\n", i, reversePageTable[i].lastUseTime, lastedtime);
-				if(reversePageTable[i].lastUseTime < lastedtime)
-				{
-					index = i;
-					lastedtime = reversePageTable[i].lastUseTime;
-				}
+				if(!entry->use)
+					return frame;
+				ClearUse(frame);
 			}
 		}
 	}
-	else
-		refreshPage(index);
-	DEBUG("a", "swap out page : %d\n",index);
-	if(reversePageTable[index].dirty)
-	{
-		Thread* ownerThread = (Thread*)reversePageTable[index].ownerThread;
-		int inSwapAddr = ownerThread->space->transVirtualAddr(
-					reversePageTable[index].virtualPage * PageSize);
-		ownerThread->space->swap->WriteAt(
-			&(machine->mainMemory[index*PageSize])
-			, PageSize, inSwapAddr);
-	}
-	reversePageTable[index].dirty = FALSE;
-	reversePageTable[index].valid = FALSE;
-	pageMap->Clear(index);
+	return -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::FindWSClockVictim
+// 	WSClock: a frame whose use bit is set is in the working set; clear
+//	the bit and note the time.  An unused frame not referenced for
+//	WorkingSetWindow ticks is evicted if it is clean.  If it is dirty
+//	it is written back (at most WSClockMaxCleans per call) so that a
+//	later sweep can take it.  If every page is in the working set,
+//	fall back to the first clean page seen, or to any page.
+//----------------------------------------------------------------------
+
+int Machine::FindWSClockVictim()
+{
+	int now = stats->totalTicks;
+	int cleans = 0;
+	int fallback = -1;
 
-	for(int i = 0; i < TLBSize; i++)
+	for(int n = 0; n < 2 * NumPhysPages; n++)
 	{
-		if(tlb[i].valid && tlb[i].virtualPage == reversePageTable[index].virtualPage
-			&& ((Thread*)reversePageTable[index].ownerThread) == currentThread)
+		int frame = clockHand;
+		TranslationEntry *entry = &reversePageTable[frame];
+		clockHand = (clockHand + 1) % NumPhysPages;
+		if(!entry->valid)
+			continue;
+		refreshPage(frame);
+		if(entry->use)
 		{
-			tlb[i].valid = FALSE;
-			break;
+			ClearUse(frame);
+			entry->lastUseTime = now;
 		}
+		else if(now - entry->lastUseTime > WorkingSetWindow)
+		{
+			if(!entry->dirty)
+				return frame;
+			if(cleans < WSClockMaxCleans)
+			{
+				PageWriteBack(frame);
+				stats->numPageCleans++;
+				cleans++;
+			}
+		}
+		if(fallback < 0 || (reversePageTable[fallback].dirty &&
+			!entry->dirty))
+			fallback = frame;
 	}
+	return fallback;
 }
 
-void Machine::RefreshSwap()
+//----------------------------------------------------------------------
+// Machine::EvictFrame
+// 	Evict the page in "frame", first writing it to swap if it is dirty.
+//	The write can block, and while it does the owner may run and use
+//	the page again; the page is only dropped if it is still there
+//	and still clean afterwards.
+//
+//	Returns TRUE if the frame was freed.
+//----------------------------------------------------------------------
+
+bool Machine::EvictFrame(int frame)
 {
-	for(int i = 0; i < NumPhysPages; i++)
+	TranslationEntry *entry = &reversePageTable[frame];
+	void *owner = entry->owner;
+	int vpn = entry->virtualPage;
+	bool wrote = FALSE;
+
+	refreshPage(frame);
+	if(entry->dirty)
 	{
-		if(reversePageTable[i].valid)
+		PageWriteBack(frame);
+		wrote = TRUE;
+	}
+	if(!entry->valid || entry->owner != owner ||
+		entry->virtualPage != vpn)
+		return FALSE;		// evicted by someone else meanwhile
+	refreshPage(frame);
+	if(entry->dirty)
+		return FALSE;		// written again while being cleaned
+
+	DEBUG('a', "swap out page : %d\n", frame);
+	stats->numEvictions++;
+	if(wrote)
+		stats->numDirtyEvictions++;
+	FreeFrame(frame);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::PageSwap
+// 	Evict the page in frame "index", or in a frame chosen by the
+//	replacement policy if "index" is -1.
+//
+//	Returns TRUE if a frame was freed.
+//----------------------------------------------------------------------
+
+bool Machine::PageSwap(int index = -1)
+{
+	if(index == -1)
+		index = FindVictim();
+	if(index < 0)
+		return FALSE;
+	return EvictFrame(index);
+}
+
+//----------------------------------------------------------------------
+// PagerThread
+// 	Body of the page-out daemon; see Machine::Pager.
+//----------------------------------------------------------------------
+
+static void
+PagerThread(int arg)
+{
+	machine->Pager();
+}
+
+//----------------------------------------------------------------------
+// Machine::StartPager
+// 	Fork the page-out daemon.  Until this is called, every frame is
+//	freed on the page fault path.
+//----------------------------------------------------------------------
+
+void Machine::StartPager()
+{
+	Thread *t = new Thread("pager");
+
+	pagerWakeup = new Semaphore("pager", 0);
+	pagerAwake = FALSE;
+	t->Fork(PagerThread, 0);
+}
+
+//----------------------------------------------------------------------
+// Machine::Pager
+// 	Page-out daemon.  Sleeps until the number of free frames drops
+//	below PagerLowWater, then evicts pages, chosen by the replacement
+//	policy, until PagerHighWater frames are free.  Its write-backs
+//	wait on the disk while user programs keep running, so page faults
+//	usually find a free frame without writing anything.
+//----------------------------------------------------------------------
+
+void Machine::Pager()
+{
+	for(;;)
+	{
+		pagerWakeup->P();
+		DEBUG('a', "pager awake, %d frames free\n", pageMap->NumClear());
+		while(pageMap->NumClear() < PagerHighWater)
 		{
-			refreshPage(i);
-			Thread* ownerThread = (Thread*)reversePageTable[i].ownerThread;
-			if(reversePageTable[i].dirty)
-			{
-				int inSwapAddr = ownerThread->space->transVirtualAddr(
-					reversePageTable[i].virtualPage * PageSize);
-				ownerThread->space->swap->WriteAt(
-					&(machine->mainMemory[i*PageSize])
-					, PageSize, inSwapAddr);
-			}
+			int seen = frameEvents;
+
+			if(PageSwap())
+				stats->numPagerEvictions++;
+			else
+				WaitForFrame(seen);	// let the owner or the
+						// loader finish with it
 		}
+		pagerAwake = FALSE;
 	}
 }
 
-void Machine::PageLoad(int virtAddr)
+//----------------------------------------------------------------------
+// Machine::WakePager
+// 	Wake the page-out daemon if the free frame pool is running low.
+//----------------------------------------------------------------------
+
+void Machine::WakePager()
 {
-	int vpn = virtAddr / PageSize;
-	if(pageMap->NumClear() == 0)
+	if(pagerWakeup != NULL && !pagerAwake &&
+		pageMap->NumClear() < PagerLowWater)
 	{
-		PageSwap();
+		pagerAwake = TRUE;
+		pagerWakeup->V();
 	}
+}
 
-	int physicalPage;
-	while((physicalPage = pageMap->Find()) == -1)
-		PageSwap();
+//----------------------------------------------------------------------
+// Machine::FrameEvent
+// 	Note that a frame was freed, that a page finished loading into
+//	one, or that one was written back, and wake every thread that
+//	found no frame it could evict: it may find one now.
+//----------------------------------------------------------------------
 
+void Machine::FrameEvent()
+{
+	frameEvents++;
+	for(; frameWaiters > 0; frameWaiters--)
+		frameWait->V();
+}
+
+//----------------------------------------------------------------------
+// Machine::WaitForFrame
+// 	Called when no frame could be evicted (every candidate is being
+//	loaded, or was used again while being cleaned).  Sleep until the
+//	next FrameEvent, unless one has happened since "frameEvents" was
+//	"seen", in which case there may already be something to evict.
+//----------------------------------------------------------------------
+
+void Machine::WaitForFrame(int seen)
+{
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+	if(frameEvents == seen)
+	{
+		if(frameWait == NULL)
+			frameWait = new Semaphore("frame wait", 0);
+		frameWaiters++;
+		frameWait->P();
+	}
+	(void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Machine::AllocFrame
+// 	Take a free frame, evicting a page ourselves if the pager has not
+//	kept any free.  May block.
+//----------------------------------------------------------------------
+
+int Machine::AllocFrame()
+{
+	int frame;
+
+	while((frame = pageMap->Find()) == -1)
+	{
+		int seen = frameEvents;
+
+		if(!PageSwap())		// pool empty: free a frame ourselves
+			WaitForFrame(seen);
+	}
+	WakePager();
+	InvalidateDecoded(frame);
+	return frame;
+}
+
+//----------------------------------------------------------------------
+// Machine::PageLoad
+// 	Bring the page containing "virtAddr" of the running address space
+//	into memory, and into the TLB.  A page that has never been written
+//	to swap is read from the executable, or zero-filled.  A page
+//	shared copy-on-write is mapped read-only.
+//----------------------------------------------------------------------
+
+void Machine::PageLoad(int virtAddr)
+{
+	int vpn = virtAddr / PageSize;
+	AddrSpace *space = currentThread->space;
+	SwapPage *page = space->pages[vpn];
+
+	if(page == NULL)	// first touch
+		page = space->pages[vpn] = new SwapPage(space->swap);
+
+	int physicalPage = AllocFrame();
 	TranslationEntry *entry = &reversePageTable[physicalPage];
 
-	int inSwapAddr = currentThread->space->transVirtualAddr(vpn*PageSize);
+	if(page->InSwap())
+		page->Read(&mainMemory[physicalPage * PageSize]);
+	else
+		space->InitialPage(vpn, &mainMemory[physicalPage * PageSize]);
+	space->TLBMissCount++;
 
-	currentThread->space->swap->ReadAt(
-		&(machine->mainMemory[physicalPage * PageSize]),
-		PageSize, inSwapAddr);
+	TranslationEntry *loaded = PageLookup(page, vpn);
+	if(loaded != NULL)
+	{	// a space sharing the page loaded it while we were reading
+		pageMap->Clear(physicalPage);
+		FrameEvent();
+		TLBLoad(vpn, loaded);
+		return;
+	}
 
 	entry->valid = TRUE;
 	entry->virtualPage = vpn;
 	entry->use = TRUE;
 	entry->dirty = FALSE;
-	entry->readOnly = FALSE;
+	entry->readOnly = (page->refs > 1 || page->IsText());
 
 	entry->lastUseTime = stats->totalTicks;
-	entry->ownerThread = (void*)currentThread;
-	currentThread->space->TLBMissCount++;
+	entry->owner = (void*)page;
+	PageHashInsert(entry);
 	TLBLoad(vpn, entry);
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyOnWrite
+// 	Handle a write to the read-only page containing "virtAddr".  If
+//	the page is still shared with another address space, the running
+//	space gets a copy of its own, in a new frame and a new slot of its
+//	swap file.  Otherwise the other sharers have gone, and the page
+//	is just made writable.
+//----------------------------------------------------------------------
+
+void Machine::CopyOnWrite(int virtAddr)
+{
+	int vpn = virtAddr / PageSize;
+	AddrSpace *space = currentThread->space;
+	SwapPage *page = space->pages[vpn];
+	TranslationEntry *entry;
+
+	if(page->refs == 1 && !page->IsText())
+	{
+		entry = PageLookup(page, vpn);
+		if(entry != NULL)	// else it is loaded writable next time
+			FrameReadOnly(entry->physicalPage, FALSE);
+		return;
+	}
+
+	DEBUG('a', "copy-on-write of page %d\n", vpn);
+	int frame = AllocFrame();
+	entry = PageLookup(page, vpn);		// it may be gone by now
+	if(entry != NULL)
+		bcopy(&mainMemory[entry->physicalPage * PageSize],
+			&mainMemory[frame * PageSize], PageSize);
+	else if(page->InSwap())
+		page->Read(&mainMemory[frame * PageSize]);
+	else
+		space->InitialPage(vpn, &mainMemory[frame * PageSize]);
+
+	SwapPage *copy = new SwapPage(space->swap);
+	space->ReleasePage(vpn);
+	space->pages[vpn] = copy;
+
+	entry = &reversePageTable[frame];
+	entry->valid = TRUE;
+	entry->virtualPage = vpn;
+	entry->use = TRUE;
+	entry->dirty = TRUE;		// the slot has never been written
+	entry->readOnly = FALSE;
+	entry->lastUseTime = stats->totalTicks;
+	entry->owner = (void*)copy;
+	PageHashInsert(entry);
+
+	int i = TLBLookup(vpn, currentASID);	// still maps the shared frame
+	if(i >= 0)
+		TLBInvalidate(i);
+	TLBLoad(vpn, entry);
+	stats->numCopyOnWrite++;
+}
@@ -42,7 +42,12 @@ class TranslationEntry {
 			// page is modified.
     int lastUseTime;
 
-    void* ownerThread;
+    void* owner;	// What the page in this frame is (a SwapPage);
+			// frames are looked up by (owner, virtualPage).
+    TranslationEntry *next;	// Next entry in the same inverted page
+				// table hash bucket.
+    int asid;		// Address space the translation belongs to
+			// (TLB entries only).
 };
 
 #endif
@@ -271,6 +271,25 @@ List::SortedRemove(int *keyPtr)
     return thing;
 }
 
+//----------------------------------------------------------------------
+// List::SortedFirst
+//      Return the first "item" of a sorted list without removing it.
+// 
+// Returns:
+//	Pointer to the first item, NULL if nothing on the list.
+//	Sets *keyPtr to the priority value of that item.
+//----------------------------------------------------------------------
+
+void *
+List::SortedFirst(int *keyPtr)
+{
+    if (IsEmpty()) 
+	return NULL;
+    if (keyPtr != NULL)
+        *keyPtr = first->key;
+    return first->item;
+}
+
 bool
 List::Find(void* item)
 {
@@ -64,6 +64,8 @@ class List {
     void SortedInsert(void *item, int sortKey);	// Put item into list
     void SortedInsertReverse(void *item, int sortKey);
     void *SortedRemove(int *keyPtr); 	  	// Remove first item from list
+    void *SortedFirst(int *keyPtr);		// Look at first item, leaving
+						// it on the list
 
   private:
     ListElement *first;  	// Head of the list, NULL if list is empty
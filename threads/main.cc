@@ -9,8 +9,10 @@
 // 	Most of this file is not needed until later assignments.
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
-//		-f -cp <unix file> <nachos file>
+//		-s -b -tlb <entries> <ways> -pr <policy>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
+//		-f -cp <unix file> <nachos file> -bc <buffers> -ext
+//		-ds <policy>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
 //              -o <other machine id>
@@ -22,6 +24,11 @@
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -b executes user programs a basic block at a time (same results,
+//       faster simulation)
+//    -tlb sets the number of TLB entries and their associativity
+//    -pr selects the page replacement policy: lru, clock, esc (enhanced
+//       second chance) or wsclock
 //    -x runs a user program
 //    -c tests the console
 //
@@ -33,6 +40,10 @@
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
 //    -t tests the performance of the Nachos file system
+//    -bc sets the number of sectors kept in the disk buffer cache
+//    -ext lays out files created from now on as extents (runs of
+//       contiguous sectors) rather than a list of sectors
+//    -ds selects the disk request scheduler: fifo, scan, clook or sstf
 //
 //  NETWORK
 //    -n sets the network reliability
@@ -11,8 +11,8 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Threads are scheduled by priority, through a multilevel feedback
+//	queue, and round robin within a priority level.  See scheduler.h.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -25,83 +25,174 @@
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads to empty.
-//  Initialize the list of all threads to empty.
+//  Initialize the thread table, with every id free.
 //----------------------------------------------------------------------
 
 Scheduler::Scheduler()
 { 
-    readyList = new List; 
-    allList = new List;
+    for (int i = 0; i < NumPriorities; i++)
+        readyQueue[i] = new List;
+    readyLevels = 0;
+    lastBoost = 0;
     suspendList = new List;
-#ifdef USER_PROGRAM
-    threadMap = new BitMap(MaxThreadNum);
-    threadEntry = new Thread*[MaxThreadNum];
-#endif
+    slots = NULL;
+    numSlots = 0;
+    freeSlot = -1;
+    GrowSlots();
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
 // 	De-allocate the list of ready threads.
-//  De-allocate the list of all threads.
+//  De-allocate the thread table.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
-    delete allList;
+    for (int i = 0; i < NumPriorities; i++)
+        delete readyQueue[i];
     delete suspendList;
-#ifdef USER_PROGRAM
-    delete threadMap;
-    delete [] threadEntry;
-#endif
+    for (int i = 0; i < numSlots; i++)
+        delete slots[i].joiners;
+    delete [] slots;
 } 
 
+//----------------------------------------------------------------------
+// Scheduler::GrowSlots
+//  Double the size of the thread table (or create it), and put the
+//  new ids on the free list, lowest first.
+//----------------------------------------------------------------------
+
+void
+Scheduler::GrowSlots()
+{
+    int newSize = (numSlots == 0) ? InitialThreadNum : 2 * numSlots;
+    ThreadSlot *newSlots = new ThreadSlot[newSize];
+
+    for (int i = 0; i < numSlots; i++)
+        newSlots[i] = slots[i];
+    for (int i = newSize - 1; i >= numSlots; i--) {
+        newSlots[i].thread = NULL;
+        newSlots[i].exited = FALSE;
+        newSlots[i].joiners = NULL;
+        newSlots[i].numJoiners = 0;
+        newSlots[i].nextFree = freeSlot;
+        freeSlot = i;
+    }
+    delete [] slots;
+    slots = newSlots;
+    numSlots = newSize;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FreeSlot
+//  Put thread id "tid" back on the free list.
+//----------------------------------------------------------------------
+
+void
+Scheduler::FreeSlot(int tid)
+{
+    slots[tid].thread = NULL;
+    slots[tid].exited = FALSE;
+    slots[tid].nextFree = freeSlot;
+    freeSlot = tid;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::AddThread
-//  add a thread to all threads list
-//  if success, return threadID
-//  else, return -1
+//  Enter a new thread in the thread table, growing it if every id
+//  is taken, and return the thread's id.
 //----------------------------------------------------------------------
 
 int
 Scheduler::AddThread(Thread *thread)
 {
-#ifdef USER_PROGRAM
-    int tid = threadMap->Find();
-    if(tid == -1)
-        return -1;
-    threadEntry[tid] = thread;
+    int tid;
+
+    if (freeSlot == -1)
+        GrowSlots();
+    tid = freeSlot;
+    freeSlot = slots[tid].nextFree;
+    slots[tid].thread = thread;
+    slots[tid].exited = FALSE;
     thread->settid(tid);
-#endif
-    if(allList->NumInList() > 128)
-        return -1;
-    allList->SortedInsert(thread, thread->gettid());
-    return thread->gettid();
+    return tid;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::RemoveThread
-//  remove a thread from all threads List
+//  Take a finished thread out of the thread table, and wake up any
+//  threads joining it.  Its id is free for reuse at once, unless it
+//  has left an exit status for Join, or joiners still have to
+//  collect theirs.
+//
+//	Assumes interrupts are disabled.
 //----------------------------------------------------------------------
 
 void 
 Scheduler::RemoveThread(Thread *thread)
 {
-#ifdef USER_PROGRAM
+    ThreadSlot *slot;
+    Thread *joiner;
     int tid = thread->gettid();
-    if(threadMap->Test(tid))
-    {
-        threadEntry[tid] = NULL;
-        threadMap->Clear(tid);
+
+    ASSERT(tid >= 0 && tid < numSlots && slots[tid].thread == thread);
+    slot = &slots[tid];
+    slot->thread = NULL;
+    if (slot->joiners != NULL)
+        while ((joiner = (Thread *)slot->joiners->Remove()) != NULL)
+            ReadyToRun(joiner);
+    if (slot->numJoiners == 0 && !slot->exited)
+        FreeSlot(tid);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Join
+//  Wait for thread "tid" to finish, sleeping on its queue of joiners
+//  if it is still running, and return its exit status.  The last
+//  joiner to collect the status frees the thread's id.
+//
+//  Return -1 if there is no such thread (it may have been joined
+//  already), or it finished without an exit status.
+//----------------------------------------------------------------------
+
+int
+Scheduler::Join(int tid)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int status = -1;
+
+    if (tid < 0 || tid >= numSlots || tid == currentThread->gettid()
+            || (slots[tid].thread == NULL && !slots[tid].exited
+                                        && slots[tid].numJoiners == 0)) {
+        (void) interrupt->SetLevel(oldLevel);
+        return -1;
     }
-#endif
-    allList->Remove(thread);
+    if (slots[tid].thread != NULL) {
+        if (slots[tid].joiners == NULL)
+            slots[tid].joiners = new List;
+        slots[tid].joiners->Append(currentThread);
+        slots[tid].numJoiners++;
+        currentThread->Sleep();		// woken by RemoveThread
+        slots[tid].numJoiners--;	// the table may have moved, so
+    }					// index it afresh
+    if (slots[tid].exited)
+        status = slots[tid].exitStatus;
+    if (slots[tid].numJoiners == 0)
+        FreeSlot(tid);
+    (void) interrupt->SetLevel(oldLevel);
+    return status;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
-//	Put it on the ready list, for later scheduling onto the CPU.
+//	Put it on the ready list, for later scheduling onto the CPU,
+//	at the end of the queue for its priority.
+//
+//	A thread that was blocked is raised a level, with a fresh
+//	quantum, so that threads that mostly wait for I/O get the CPU
+//	quickly when they want it.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
@@ -109,17 +200,85 @@ Scheduler::RemoveThread(Thread *thread)
 void
 Scheduler::ReadyToRun(Thread *thread)
 {
-    DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
+    int level;
+
+    if (thread->isStatus(BLOCKED)) {
+        if (thread->getpriority() < MaxPriority)
+            thread->setpriority(thread->getpriority() + 1);
+        thread->setremainTime(Quantum);
+    }
+    level = max(min(thread->getpriority(), MaxPriority), 0);
+    DEBUG('t', "Putting thread %s on ready list, level %d.\n",
+                                        thread->getName(), level);
 
     thread->setStatus(READY);
-    //readyList->SortedInsertReverse((void *)thread, thread->getpriority());   //for priority
-    readyList->Append(thread);
+    readyQueue[level]->Append(thread);
+    readyLevels |= 1 << level;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::QuantumUsed
+// 	"thread" has run for a whole quantum at its level without
+//	blocking; drop it a level, so that threads that block more often
+//	go first, and give it a fresh quantum there.
+//----------------------------------------------------------------------
+
+void
+Scheduler::QuantumUsed(Thread *thread)
+{
+    if (thread->getpriority() > MaxPriority)
+        thread->setpriority(MaxPriority);
+    if (thread->getpriority() > 0)
+        thread->setpriority(thread->getpriority() - 1);
+    thread->setremainTime(Quantum);
+    DEBUG('t', "Thread %s used its quantum, now at level %d.\n",
+                                thread->getName(), thread->getpriority());
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Return TRUE if a thread on a higher level than "thread" is ready
+//	to run, so that "thread" should give up the CPU before its
+//	quantum is over.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ShouldPreempt(Thread *thread)
+{
+    int level = max(min(thread->getpriority(), MaxPriority), 0);
+
+    return (readyLevels >> (level + 1)) != 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Boost
+// 	Move every ready thread to the top level, with a fresh quantum,
+//	so that none starves on a low level.  Threads go behind the ones
+//	already there, higher levels first.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Boost()
+{
+    Thread *thread;
+
+    DEBUG('t', "Boosting all ready threads to level %d.\n", MaxPriority);
+    for (int i = MaxPriority - 1; i >= 0; i--)
+        while ((thread = (Thread *)readyQueue[i]->Remove()) != NULL) {
+            thread->setpriority(MaxPriority);
+            thread->setremainTime(Quantum);
+            readyQueue[MaxPriority]->Append(thread);
+        }
+    if (!readyQueue[MaxPriority]->IsEmpty())
+        readyLevels = 1 << MaxPriority;
+    lastBoost = stats->totalTicks;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
-//	If there are no ready threads, return NULL.
+// 	Return the next thread to be scheduled onto the CPU: the first on
+//	the highest level with any threads.  If there are no ready
+//	threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
 //----------------------------------------------------------------------
@@ -127,7 +286,18 @@ Scheduler::ReadyToRun(Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    Thread *thread;
+    int level;
+
+    if (readyLevels == 0)
+        return NULL;
+    if (stats->totalTicks - lastBoost >= BoostInterval)
+        Boost();
+    level = 31 - __builtin_clz(readyLevels);	// highest bit set
+    thread = (Thread *)readyQueue[level]->Remove();
+    if (readyQueue[level]->IsEmpty())
+        readyLevels &= ~(1 << level);
+    return thread;
 }
 
 //----------------------------------------------------------------------
@@ -161,7 +331,6 @@ Scheduler::Run (Thread *nextThread)
 
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
-    currentThread->setremainTime(500);
     DEBUG('t', "Switching from thread \"%s\" to thread \"%s\"\n",
 	  oldThread->getName(), nextThread->getName());
     
@@ -200,17 +369,20 @@ void
 Scheduler::Print()
 {
     printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    for (int i = MaxPriority; i >= 0; i--)
+        readyQueue[i]->Mapcar((VoidFunctionPtr) ThreadPrint);
 }
 
 
 //----------------------------------------------------------------------
 // Scheduler::ThreadStatus
-//  Print the ThreadStatus 
+//  Print every thread in the thread table, in order of id.
 //----------------------------------------------------------------------
 void
 Scheduler::ThreadStatus()
 {
     printf("all threads:\n");
-    allList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    for (int i = 0; i < numSlots; i++)
+        if (slots[i].thread != NULL)
+            slots[i].thread->Print();
 }
\ No newline at end of file
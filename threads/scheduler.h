@@ -2,6 +2,25 @@
 //	Data structures for the thread dispatcher and scheduler.
 //	Primarily, the list of threads that are ready to run.
 //
+//	Ready threads are kept in a multilevel feedback queue: one FIFO
+//	queue per priority level, and a bitmap of the levels whose queue
+//	is not empty, so that the highest priority thread is found in
+//	constant time.  A thread that uses up its quantum drops a level;
+//	one that blocks (on I/O, say) rises a level when it wakes up.
+//
+//	Left at that, threads that block often would end up on the top
+//	level, preempting everyone else, and a CPU-bound thread on level
+//	0 could wait for ever.  So every BoostInterval ticks, all ready
+//	threads are moved up to the top level, and have to earn their
+//	place again.
+//
+//	The scheduler also hands out thread ids, from a table indexed by
+//	id that grows as needed; free ids are kept on a list threaded
+//	through the table.  A thread that exits with a status keeps its
+//	id until the status is collected by Join.  Threads joining one
+//	that is still running sleep on a queue in its entry, and are
+//	woken when it finishes.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -13,7 +32,29 @@
 #include "list.h"
 #include "thread.h"
 
-#define MaxThreadNum 128
+#define InitialThreadNum 128	// thread ids in the table to begin with
+
+#define NumPriorities	16	// priority levels; higher runs first
+#define MaxPriority	(NumPriorities - 1)
+#define Quantum		500	// ticks a thread runs at one level before
+				// it drops to the next
+#define BoostInterval	(20 * Quantum)	// ticks between moving every
+				// ready thread to the top level
+
+// One entry in the thread table.
+
+class ThreadSlot {
+  public:
+    Thread *thread;		// The thread with this id, or NULL
+    bool exited;		// Has it exited with a status that has not
+				// been collected?
+    int exitStatus;		// The status, if so
+    List *joiners;		// Threads waiting for it to finish, or
+				// NULL if none ever have
+    int numJoiners;		// Joiners that have not yet collected
+				// the status
+    int nextFree;		// Next free id, if this one is free
+};
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
@@ -23,37 +64,40 @@ class Scheduler {
   public:
     Scheduler();			// Initialize list of ready threads 
     ~Scheduler();			// De-allocate ready list
-    void ThreadStatus();
-    int AddThread(Thread *thread);
-    void RemoveThread(Thread *thread);
+    void ThreadStatus();		// Print every thread
+    int AddThread(Thread *thread);	// Give a new thread an id
+    void RemoveThread(Thread *thread);	// The thread has finished
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
-    Thread* FindNextToRun();		// Dequeue first thread on the ready 
-					// list, if any, and return thread.
+    Thread* FindNextToRun();		// Dequeue first thread on the highest
+					// non-empty level, if any, and return
+					// thread.
+    void QuantumUsed(Thread* thread);	// Thread used up its quantum; demote
+					// it
+    bool ShouldPreempt(Thread* thread);	// Is a thread of higher priority
+					// ready?
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
-#ifdef USER_PROGRAM
-    bool isActive(int tid)
-    {
-        if(threadEntry[tid]->status == BLOCKED)
-            return FALSE;
-        return threadMap->Test(tid);
-    }
-
-    int getExitNum(int tid){return exitNum[tid];}
-
-    void setExitNum(int tid, int num){exitNum[tid] = num;}
-#endif
-    List *readyList;    // queue of threads that are ready to run,
-                // but not running
+    bool isActive(int tid)		// Is the thread still running?
+        { return tid >= 0 && tid < numSlots && slots[tid].thread != NULL; }
+    void setExitNum(int tid, int num)	// Keep the thread's exit status
+        { slots[tid].exitStatus = num; slots[tid].exited = TRUE; }
+    int Join(int tid);			// Wait for a thread to finish, and
+					// return its exit status
     List *suspendList;
   private: 	
-    List *allList; // all the threads
-#ifdef USER_PROGRAM
-    #include "bitmap.h"
-    BitMap* threadMap;
-    Thread** threadEntry;
-    int exitNum[MaxThreadNum];
-#endif
+    List *readyQueue[NumPriorities];	// threads that are ready to run,
+					// but not running, by priority
+    unsigned int readyLevels;		// bit i set if readyQueue[i] is
+					// not empty
+    int lastBoost;			// when the ready threads were last
+					// moved to the top level
+    void Boost();			// move them there
+    ThreadSlot *slots;			// the thread table, indexed by id
+    int numSlots;			// size of the table
+    int freeSlot;			// first free id, or -1 if none
+
+    void FreeSlot(int tid);		// Put an id back on the free list
+    void GrowSlots();			// Double the size of the table
 };
 
 #endif // SCHEDULER_H
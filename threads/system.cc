@@ -26,6 +26,8 @@ FileSystem  *fileSystem;
 
 #ifdef FILESYS
 SynchDisk   *synchDisk;
+AllocMode fileAllocMode = BlockAlloc;
+DentryCache *dentryCache;
 RWLock **rwLockTable;
 int* rwLockSector;
 #endif
@@ -33,6 +35,7 @@ int* rwLockSector;
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
 BitMap *pageMap;
 Machine *machine;	// user program memory and registers
+TextCache *textCache;	// code pages shared between programs
 #endif
 
 #ifdef NETWORK
@@ -58,6 +61,10 @@ extern void Cleanup();
 //	if the interrupted thread called Yield at the point it is 
 //	was interrupted.
 //
+//	Each interrupt charges the running thread for a slice of its
+//	quantum; it is only preempted once the quantum is used up, or if
+//	a thread of higher priority has become ready.
+//
 //	"dummy" is because every interrupt handler takes one argument,
 //		whether it needs it or not.
 //----------------------------------------------------------------------
@@ -66,7 +73,9 @@ TimerInterruptHandler(int dummy)
 {
     currentThread->timePass(100);
     //currentThread->Print();
-    if (interrupt->getStatus() != IdleMode)
+    if (interrupt->getStatus() != IdleMode
+	    && (currentThread->getremainTime() <= 0
+		|| scheduler->ShouldPreempt(currentThread)))
 	interrupt->YieldOnReturn();
 }
 
@@ -90,10 +99,18 @@ Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    bool blockEngine = FALSE;	// run user code a basic block at a time
+    int tlbEntries = TLBSize;	// TLB geometry
+    int tlbAssoc = TLBWays;
+    ReplacePolicy replacePolicy = LRUReplace;	// page replacement
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
 #endif
+#ifdef FILESYS
+    int cacheSize = BufferCacheSize;	// sectors in the buffer cache
+    DiskSched diskSched = FIFOSched;	// disk request scheduling
+#endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
     int netname = 0;		// UNIX socket name
@@ -118,11 +135,48 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = TRUE;
+	else if (!strcmp(*argv, "-b"))
+	    blockEngine = TRUE;
+	else if (!strcmp(*argv, "-tlb")) {
+	    ASSERT(argc > 2);
+	    tlbEntries = atoi(*(argv + 1));
+	    tlbAssoc = atoi(*(argv + 2));
+	    argCount = 3;
+	} else if (!strcmp(*argv, "-pr")) {
+	    int p;
+
+	    ASSERT(argc > 1);
+	    for (p = 0; p < NumReplacePolicies; p++)
+		if (!strcmp(*(argv + 1), replacePolicyNames[p]))
+		    break;
+	    ASSERT(p < NumReplacePolicies);
+	    replacePolicy = (ReplacePolicy) p;
+	    argCount = 2;
+	}
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
 	    format = TRUE;
 #endif
+#ifdef FILESYS
+	if (!strcmp(*argv, "-bc")) {
+	    ASSERT(argc > 1);
+	    cacheSize = atoi(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-ext"))
+	    fileAllocMode = ExtentAlloc;
+	else if (!strcmp(*argv, "-ds")) {
+	    int s;
+
+	    ASSERT(argc > 1);
+	    for (s = 0; s < NumDiskScheds; s++)
+		if (!strcmp(*(argv + 1), diskSchedNames[s]))
+		    break;
+	    ASSERT(s < NumDiskScheds);
+	    diskSched = (DiskSched) s;
+	    argCount = 2;
+	}
+#endif
 #ifdef NETWORK
 	if (!strcmp(*argv, "-l")) {
 	    ASSERT(argc > 1);
@@ -156,11 +210,15 @@ Initialize(int argc, char **argv)
     
 #ifdef USER_PROGRAM
     pageMap = new BitMap(NumPhysPages);
-    machine = new Machine(debugUserProg);	// this must come first
+    machine = new Machine(debugUserProg, blockEngine, tlbEntries, tlbAssoc,
+			replacePolicy);
+						// this must come first
+    textCache = new TextCache();
 #endif
 
 #ifdef FILESYS
-    synchDisk = new SynchDisk("DISK");
+    synchDisk = new SynchDisk("DISK", cacheSize, diskSched);
+    dentryCache = new DentryCache(DentryCacheSize);
     rwLockTable = new RWLock*[100];
     rwLockSector = new int[100];
     for(int i = 0; i < 100; i++)
@@ -174,6 +232,10 @@ Initialize(int argc, char **argv)
     fileSystem = new FileSystem(format);
 #endif
 
+#ifdef VM
+    machine->StartPager();			// keep some frames free
+#endif
+
 #ifdef NETWORK
     postOffice = new PostOffice(netname, rely, 10);
 #endif
@@ -193,6 +255,7 @@ Cleanup()
     
 #ifdef USER_PROGRAM
     delete machine;
+    delete textCache;
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -200,6 +263,7 @@ Cleanup()
 #endif
 
 #ifdef FILESYS
+    delete dentryCache;
     delete synchDisk;
 #endif
     
@@ -35,6 +35,8 @@ extern Timer *timer;				// the hardware alarm clock
 extern BitMap* pageMap;
 #include "machine.h"
 extern Machine* machine;	// user program memory and registers
+#include "swap.h"
+extern TextCache *textCache;	// code pages shared between programs
 #endif
 
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
@@ -45,6 +47,10 @@ extern FileSystem  *fileSystem;
 #ifdef FILESYS
 #include "synchdisk.h"
 extern SynchDisk   *synchDisk;
+#include "filehdr.h"
+extern AllocMode fileAllocMode;	// layout of newly created files
+#include "dentrycache.h"
+extern DentryCache *dentryCache;	// names recently looked up
 extern RWLock **rwLockTable;
 extern int* rwLockSector;
 #endif
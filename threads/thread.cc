@@ -19,14 +19,12 @@
 #include "synch.h"
 #include "system.h"
 
-extern char* itoa(int num);
-
 #define STACK_FENCEPOST 0xdeadbeef	// this is put at the top of the
 					// execution stack, for detecting 
 					// stack overflows
 
-int threadCounts = 0;
-int currentCounts = 0;
+static int *stackPool[StackPoolSize];	// stacks of StackSize words, free
+static int numPooledStacks = 0;		// for the next thread forked
 
 //----------------------------------------------------------------------
 // Thread::Thread
@@ -39,26 +37,15 @@ int currentCounts = 0;
 
 Thread::Thread(char* threadName, int uid = 0, int _priority = 10, int remain = 500)
 {
-    if(currentCounts >= 128)
-    {
-        threadID = -1;
-        return;
-    }
-
-    threadID = threadCounts;
-    int success = scheduler->AddThread(this);
-    if(success == -1)
-        return;
-    threadID = success;
-    threadCounts++;
-    currentCounts++;
+    threadID = scheduler->AddThread(this);
     userID = uid;
-    priority = _priority;
+    priority = max(min(_priority, MaxPriority), 0);	// a ready queue level
     remainTime = remain;
 
     name = threadName;
     stackTop = NULL;
     stack = NULL;
+    stackSize = StackSize;
     status = JUST_CREATED;
 
     myDirectorySector = 1;
@@ -84,8 +71,12 @@ Thread::~Thread()
     DEBUG('t', "Deleting thread \"%s\"\n", name);
 
     ASSERT(this != currentThread);
-    if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    if (stack != NULL) {
+	if (stackSize == StackSize && numPooledStacks < StackPoolSize)
+	    stackPool[numPooledStacks++] = stack;
+	else
+	    DeallocBoundedArray((char *) stack, stackSize * sizeof(int));
+    }
 
 #ifdef USER_PROGRAM
     if(space != NULL)
@@ -172,12 +163,26 @@ Thread::CheckOverflow()
 {
     if (stack != NULL)
 #ifdef HOST_SNAKE			// Stacks grow upward on the Snakes
-	ASSERT(stack[StackSize - 1] == STACK_FENCEPOST);
+	ASSERT(stack[stackSize - 1] == STACK_FENCEPOST);
 #else
 	ASSERT((int) *stack == (int) STACK_FENCEPOST);
 #endif
 }
 
+//----------------------------------------------------------------------
+// Thread::setStackSize
+// 	Give the thread a stack of "words" words, instead of StackSize,
+//	for a thread that needs a deep one (or can make do with a small
+//	one).  Only stacks of StackSize words are pooled for reuse.
+//----------------------------------------------------------------------
+
+void
+Thread::setStackSize(int words)
+{
+    ASSERT(stack == NULL && words > 0);
+    stackSize = words;
+}
+
 //----------------------------------------------------------------------
 // Thread::Finish
 // 	Called by ThreadRoot when a thread is done executing the 
@@ -198,12 +203,16 @@ void
 Thread::Finish ()
 {
     #ifdef USER_PROGRAM
-    fileSystem->Remove(itoa(currentThread->gettid()), "/", TRUE);
+    // give up our pages (and swap file) while we can still block
+    if(space != NULL)
+    {
+        delete space;
+        space = NULL;
+    }
     #endif
 
     (void) interrupt->SetLevel(IntOff);		
 
-    currentCounts--;
     scheduler->RemoveThread(this);
     ASSERT(this == currentThread);
     
@@ -223,7 +232,8 @@ Thread::Finish ()
 // Thread::Yield
 // 	Relinquish the CPU if any other thread is ready to run.
 //	If so, put the thread on the end of the ready list, so that
-//	it will eventually be re-scheduled.
+//	it will eventually be re-scheduled.  A thread that has used up
+//	its quantum goes on the list one level lower.
 //
 //	NOTE: returns immediately if no other thread on the ready queue.
 //	Otherwise returns when the thread eventually works its way
@@ -247,6 +257,8 @@ Thread::Yield ()
     
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
 
+    if (remainTime <= 0)
+        scheduler->QuantumUsed(this);
     nextThread = scheduler->FindNextToRun();
     if(nextThread != NULL)
     {
@@ -308,8 +320,9 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 
 //----------------------------------------------------------------------
 // Thread::StackAllocate
-//	Allocate and initialize an execution stack.  The stack is
-//	initialized with an initial stack frame for ThreadRoot, which:
+//	Allocate and initialize an execution stack, reusing the stack of
+//	a finished thread if one is pooled.  The stack is initialized
+//	with an initial stack frame for ThreadRoot, which:
 //		enables interrupts
 //		calls (*func)(arg)
 //		calls Thread::Finish
@@ -321,19 +334,22 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    if (stackSize == StackSize && numPooledStacks > 0)
+	stack = stackPool[--numPooledStacks];
+    else
+	stack = (int *) AllocBoundedArray(stackSize * sizeof(int));
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
     stackTop = stack + 16;	// HP requires 64-byte frame marker
-    stack[StackSize - 1] = STACK_FENCEPOST;
+    stack[stackSize - 1] = STACK_FENCEPOST;
 #else
     // i386 & MIPS & SPARC stack works from high addresses to low addresses
 #ifdef HOST_SPARC
     // SPARC stack must contains at least 1 activation record to start with.
-    stackTop = stack + StackSize - 96;
+    stackTop = stack + stackSize - 96;
 #else  // HOST_MIPS  || HOST_i386
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
 #ifdef HOST_i386
     // the 80386 passes the return address on the stack.  In order for
     // SWITCH() to go to ThreadRoot when we switch to this thread, the
@@ -404,8 +420,7 @@ Thread::Suspend()
         return;
     for(int i = 0; i < NumPhysPages; i++)
     {
-        if(machine->reversePageTable[i].valid &&
-            machine->reversePageTable[i].ownerThread == (void*)this)
+        if(space != NULL && space->Maps(&machine->reversePageTable[i]))
         {
             machine->PageSwap(i);
         }
@@ -430,8 +445,7 @@ int Thread::PagesinMem()
     int count = 0;
     for(int i = 0; i < NumPhysPages; i++)
     {
-        if(machine->reversePageTable[i].valid &&
-            machine->reversePageTable[i].ownerThread == (void*)this)
+        if(space != NULL && space->Maps(&machine->reversePageTable[i]))
         {
             count++;
         }
@@ -53,7 +53,11 @@
 
 // Size of the thread's private execution stack.
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
-#define StackSize	(4 * 1024)	// in words
+#define StackSize	(4 * 1024)	// in words, unless set per thread
+
+// Stacks of finished threads are kept for reuse, up to this many, so
+// that forking a thread seldom has to allocate one.
+#define StackPoolSize	32
 
 
 // Thread state
@@ -99,6 +103,8 @@ class Thread {
     
     void CheckOverflow();   			// Check if thread has 
 						// overflowed its stack
+    void setStackSize(int words);		// Use a stack of this size;
+						// call before Fork
 
 
     void setStatus(ThreadStatus st) { status = st; }
@@ -128,6 +134,7 @@ class Thread {
     int* stack; 	 		// Bottom of the stack 
 					// NULL if this is the main thread
 					// (If NULL, don't deallocate stack)
+    int stackSize;			// Size of the stack, in words
     char* name;
     int userID;
     int threadID;
@@ -13,6 +13,11 @@
 #include "system.h"
 #include "elevatortest.h"
 #include "synch.h"
+#include <sys/time.h>
+
+#define BenchThreads	10000	// threads forked by ThreadTest10
+#define BenchBatch	100	// forked at a time, before waiting for
+				// them to finish
 
 // testnum is set in main.cc
 int testnum = 1;
@@ -26,6 +31,8 @@ Semaphore* full;
 Semaphore* empty;
 Barrier* barrier;
 RWLock* rwlock;
+int benchDone;
+Semaphore* batchDone;
 //----------------------------------------------------------------------
 // SimpleThread
 // 	Loop 5 times, yielding the CPU to another ready thread 
@@ -224,6 +231,12 @@ void WriterThread(int dummy)
         rwlock->Write_end();
     }
 }
+void EmptyThread(int dummy)
+{
+    if(++benchDone == BenchBatch)
+        batchDone->V();
+}
+
 //----------------------------------------------------------------------
 // ThreadTest1
 // 	Set up a ping-pong between two threads, by forking a thread 
@@ -252,11 +265,6 @@ ThreadTest2()
     for(int i = 0; i < 130; i++)
     {
         Thread *t = new Thread("forked thread", testnum);
-        if(t->gettid() == -1)
-        {
-            printf("can't fork!\n");
-            continue;
-        }
         t->Fork(PrintThread, (void*)1);
     }
     PrintThread(0);
@@ -274,11 +282,6 @@ ThreadTest3()
             t = new Thread("forked thread", 1, 9);
         else
             t = new Thread("forked thread", 2, 11);
-        if(t->gettid() == -1)
-        {
-            printf("can't fork!\n");
-            continue;
-        }
         t->Fork(PrintThread, (void*)t->gettid());
     }
     PrintThread(0);
@@ -292,10 +295,6 @@ ThreadTest4()
     for(int i = 0; i < 4; i++)
     {
         Thread *t = new Thread("forked thread", testnum, 11);
-        if(t->gettid() == -1)
-        {
-            printf("can't fork!\n");
-        }
         t->Fork(TickThread, (void*)1);
     }
     scheduler->Print();
@@ -309,10 +308,6 @@ ThreadTest5()
     for(int i = 0; i < 2; i++)
     {
         Thread *t = new Thread("forked thread", testnum, 5);
-        if(t->gettid() == -1)
-        {
-            printf("can't fork!\n");
-        }
         t->Fork(ConditionThread, (void*)i);
     }
 }
@@ -323,16 +318,8 @@ ThreadTest6()
     notfull = new Condition("notfull");
     notempty = new Condition("notempty");
     Thread *producer = new Thread("producer", testnum, 5);
-    if(producer->gettid() == -1)
-    {
-        printf("can't fork!\n");
-    }
     producer->Fork(producerThread, (void*)1);
     Thread *consumer = new Thread("consumer", testnum, 5);
-    if(consumer->gettid() == -1)
-    {
-        printf("can't fork!\n");
-    }
     consumer->Fork(consumerThread, (void*)1);
 }
 
@@ -342,16 +329,8 @@ ThreadTest7()
     empty = new Semaphore("empty", 10);
     full = new Semaphore("full", 0);
     Thread *producer = new Thread("producer", testnum, 5);
-    if(producer->gettid() == -1)
-    {
-        printf("can't fork!\n");
-    }
     producer->Fork(producerThreadSem, (void*)1);
     Thread *consumer = new Thread("consumer", testnum, 5);
-    if(consumer->gettid() == -1)
-    {
-        printf("can't fork!\n");
-    }
     consumer->Fork(consumerThreadSem, (void*)1);
 }
 
@@ -361,10 +340,6 @@ ThreadTest8()
     for(int i = 0; i < 5; i++)
     {
         Thread *t = new Thread("forked thread", testnum, 5);
-        if(t->gettid() == -1)
-        {
-            printf("can't fork!\n");
-        }
         t->Fork(BarrierThread, (void*)i);
     }
 }
@@ -376,22 +351,55 @@ ThreadTest9()
     for(int i = 0; i < 5 ; i++)
     {
         Thread *t = new Thread("forked thread", testnum, 5);
-        if(t->gettid() == -1)
-        {
-            printf("can't fork!\n");
-        }
         t->Fork(ReaderThread, (void*)i);
     }
     for(int i = 0; i < 2 ; i++)
     {
         Thread *t = new Thread("forked thread", testnum, 5);
-        if(t->gettid() == -1)
+        t->Fork(WriterThread, (void*)i);
+    }
+}
+//----------------------------------------------------------------------
+// ThreadTest10
+//  Measure how fast threads can be created: fork BenchThreads threads
+//  that do nothing, BenchBatch at a time, waiting for each batch to
+//  finish, and report the threads per second of real time.  The last
+//  thread of a batch wakes us, so waiting costs no extra switches.
+//----------------------------------------------------------------------
+
+void
+ThreadTest10()
+{
+    struct timeval start, end;
+    int startTicks = stats->totalTicks;
+    int forked = 0, usecs;
+
+    DEBUG('t', "Entering ThreadTest10");
+    batchDone = new Semaphore("batch done", 0);
+    gettimeofday(&start, NULL);
+    while (forked < BenchThreads)
+    {
+        benchDone = 0;
+        for(int i = 0; i < BenchBatch; i++)
         {
-            printf("can't fork!\n");
+            Thread *t = new Thread("bench thread", testnum);
+            t->Fork(EmptyThread, (void*)0);
         }
-        t->Fork(WriterThread, (void*)i);
+        batchDone->P();
+        forked += BenchBatch;
     }
+    gettimeofday(&end, NULL);
+
+    usecs = (end.tv_sec - start.tv_sec) * 1000000
+                + (end.tv_usec - start.tv_usec);
+    if(usecs == 0)
+        usecs = 1;
+    printf("%d threads forked and finished in %d us, %d threads/s, "
+        "%d ticks\n", forked, usecs, (int)(forked * 1000000.0 / usecs),
+        stats->totalTicks - startTicks);
+    delete batchDone;
 }
+
 //----------------------------------------------------------------------
 // ThreadTest
 // 	Invoke a test routine.
@@ -428,6 +436,9 @@ ThreadTest()
     case 9:
     ThreadTest9();
     break;
+    case 10:
+    ThreadTest10();
+    break;
     default:
 	printf("No test specified.\n");
 	break;
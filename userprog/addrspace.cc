@@ -22,28 +22,6 @@
 #include <strings.h>
 #endif
 
-char* itoa(int num)
-{
-    char* _ret = new char[10];
-    int i = 0;
-    if(num == 0)
-    {
-        _ret[0] = '0';
-        i++;
-    }
-    while(num > 0)
-    {
-        int left = num % 10;
-        char tmp = '0' + left;
-        _ret[i] = tmp;
-        i++;
-        num = num / 10;
-    }
-    _ret[i] = '\0';
-    //printf("%s\n", _ret);
-    return _ret;
-}
-
 //----------------------------------------------------------------------
 // SwapHeader
 // 	Do little endian to big endian conversion on the bytes in the 
@@ -78,77 +56,112 @@ SwapHeader (NoffHeader *noffH)
 //	memory.  For now, this is really simple (1:1), since we are
 //	only uniprogramming, and we have a single unsegmented page table
 //
-//	"executable" is the file containing the object code to load into memory
+//	"file" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
 
-AddrSpace::AddrSpace(OpenFile *executable, int tid = -1)
+AddrSpace::AddrSpace(OpenFile *file)
 {
-    if(tid == -1)
-        tid = currentThread->gettid();
-    LoadSwapSpace(executable, tid);
+    LoadExecutable(file);
 
 // first, set up the translation 
     TLBMissCount = 0;
+    TLBAccessCount = 0;
     PageFaultCount = 0;
-#ifdef TLB_FIFO
-    TLBFIFO_List = new List;
-#endif
+    asid = -1;
+    asidGeneration = 0;
+    accessMark = -1;
 
 }
 
-AddrSpace::AddrSpace(AddrSpace *space, int tid = -1)
+AddrSpace::AddrSpace(AddrSpace *space)
 {
-    if(tid == -1)
-        tid = currentThread->gettid();
-
     TLBMissCount = 0;
+    TLBAccessCount = 0;
     PageFaultCount = 0;
-#ifdef TLB_FIFO
-    TLBFIFO_List = new List;
-#endif
+    asid = -1;
+    asidGeneration = 0;
+    accessMark = -1;
 
     numPages = space->getNumPages();
-    unsigned int size;
-    size = numPages * PageSize;
-
-    DEBUG('a', "loadint swap space, num pages %d, size %d\n", 
-                numPages, size);
-
-    char* Buffer = new char[size];
-
-    space->swap->ReadAt(Buffer, size, 0);
+    noffH = space->noffH;
 
+    DEBUG('a', "sharing %d pages copy-on-write\n", numPages);
 
-    char* swapname = itoa(tid);
-    fileSystem->Create(swapname, size);
-    swap = fileSystem->Open(swapname);
-    swap->WriteAt(Buffer,size,0);
-
-    delete [] Buffer;
+    executable = new OpenFile(space->executable->HeaderSector());
+    swap = new SwapFile();
+    pages = new SwapPage*[numPages];
+    for(unsigned int vpn = 0; vpn < numPages; vpn++)
+    {
+        pages[vpn] = space->pages[vpn];
+        if(pages[vpn] == NULL)
+            continue;           // not touched: we load it ourselves
+        pages[vpn]->refs++;
+
+        // the parent must not write to the frame in place any more
+        TranslationEntry *entry = machine->PageLookup(pages[vpn], vpn);
+        if(entry != NULL)
+            machine->FrameReadOnly(entry->physicalPage, TRUE);
+    }
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.  Nothing for now!
+// 	Dealloate an address space, giving up its pages.  Pages still
+//	shared with another space stay where they are.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-    //machine->leftPages += maxPagesinMem;
-    for(int i = 0; i < NumPhysPages; i++)
+    for(unsigned int vpn = 0; vpn < numPages; vpn++)
+        ReleasePage(vpn);
+    delete [] pages;
+    swap->Unref();
+    delete executable;
+#ifdef USE_TLB
+    // free the TLB slots still tagged with our ID
+    if(asidGeneration == machine->asidGeneration)
     {
-        if(machine->reversePageTable[i].valid &&
-            machine->reversePageTable[i].ownerThread == (void*) threadToBeDestroyed)
+        for(int i = 0; i < machine->tlbSize; i++)
         {
-            pageMap->Clear(i);
-            machine->reversePageTable[i].valid = FALSE;
+            if(machine->tlb[i].valid && machine->tlb[i].asid == asid)
+                machine->TLBInvalidate(i);
         }
     }
-#ifdef TLB_FIFO
-    delete TLBFIFO_List;
 #endif
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::ReleasePage
+// 	Stop mapping virtual page "vpn".  If no other address space
+//	shares the page, the frame holding it and its swap slot are freed.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReleasePage(int vpn)
+{
+    SwapPage *page = pages[vpn];
+
+    pages[vpn] = NULL;
+    if(page == NULL || --page->refs > 0)
+        return;
+    TranslationEntry *entry = machine->PageLookup(page, vpn);
+    if(entry != NULL)
+        machine->FreeFrame(entry->physicalPage);
+    delete page;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Maps
+// 	Return TRUE if "frame" holds a page of this address space.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Maps(TranslationEntry *frame)
+{
+    return frame->valid && (unsigned) frame->virtualPage < numPages &&
+        pages[frame->virtualPage] == frame->owner;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::InitRegisters
 // 	Set the initial values for the user-level register set.
@@ -186,17 +199,19 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	The TLB is left alone: its entries are tagged with our ID, so
+//	they are still good when we are switched back in.  Only the
+//	number of memory accesses made while we ran is recorded.  Safe
+//	to call more than once.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
 {
     #ifdef USE_TLB
-    for(int i = 0; i < TLBSize; i++)
+    if(accessMark >= 0)
     {
-        machine->tlb[i].valid = FALSE;
-        machine->tlb[i].dirty = FALSE;
-        machine->tlb[i].readOnly = FALSE;
+        TLBAccessCount += machine->tlbAccesses - accessMark;
+        accessMark = -1;
     }
     #endif
 }
@@ -206,85 +221,104 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      Tell the machine which TLB entries are ours, first taking a new
+//	ID if ours was recycled while we were switched out.
 //----------------------------------------------------------------------
 
-
-
 void AddrSpace::RestoreState() 
 {
-
+    #ifdef USE_TLB
+    if(asidGeneration != machine->asidGeneration)
+    {
+        asid = machine->NewASID();
+        asidGeneration = machine->asidGeneration;
+        DEBUG('a', "address space gets ID %d\n", asid);
+    }
+    machine->currentASID = asid;
+    accessMark = machine->tlbAccesses;
+    #endif
 }
 
-void AddrSpace::LoadSwapSpace(OpenFile *executable, int tid)
-{
-    unsigned int i, size;
+//----------------------------------------------------------------------
+// AddrSpace::LoadExecutable
+// 	Read the NOFF header of "file" and size the address space from it.
+//	Nothing else is read: pages are brought in from the executable,
+//	which is kept open, the first time they are touched.  Pages that
+//	hold only code are shared with every other address space running
+//	the same executable.
+//----------------------------------------------------------------------
 
-    executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
+void AddrSpace::LoadExecutable(OpenFile *file)
+{
+    file->ReadAt((char *)&noffH, sizeof(noffH), 0);
     if ((noffH.noffMagic != NOFFMAGIC) && 
         (WordToHost(noffH.noffMagic) == NOFFMAGIC))
         SwapHeader(&noffH);
     ASSERT(noffH.noffMagic == NOFFMAGIC);
 
-
 // how big is address space?
-    size = noffH.code.size + noffH.initData.size + noffH.uninitData.size 
-            + UserStackSize;    // we need to increase the size
+    unsigned int size = noffH.code.size + noffH.initData.size
+            + noffH.uninitData.size + UserStackSize;
+                        // we need to increase the size
                         // to leave room for the stack
     numPages = divRoundUp(size, PageSize);
-    size = numPages * PageSize;
-
-    DEBUG('a', "loadint swap space, num pages %d, size %d\n", 
-                numPages, size);
-
-    char* Buffer = new char[size];
-    memset(Buffer,0,sizeof(Buffer));
-
-    /*
-    printf("noffH.code.virtualAddr : %d\n", noffH.code.virtualAddr);
-    printf("noffH.code.size : %d\n", noffH.code.size);
-    printf("noffH.initData.virtualAddr : %d\n", noffH.initData.virtualAddr);
-    printf("noffH.initData.size : %d\n", noffH.initData.size);
-    printf("noffH.uninitData.virtualAddr : %d\n", noffH.uninitData.virtualAddr);
-    printf("noffH.uninitData.size : %d\n", noffH.uninitData.size);
-    */
-
-
-    if(noffH.code.size > 0)
-    {
-        executable->ReadAt(Buffer, noffH.code.size, noffH.code.inFileAddr);
-    }
-    if(noffH.initData.size > 0)
+    ASSERT((unsigned) (noffH.code.virtualAddr + noffH.code.size)
+            <= numPages * PageSize);
+    ASSERT((unsigned) (noffH.initData.virtualAddr + noffH.initData.size)
+            <= numPages * PageSize);
+
+    DEBUG('a', "demand paging %d pages\n", numPages);
+
+    int sector = file->HeaderSector();
+    executable = new OpenFile(sector);
+    swap = new SwapFile();
+    pages = new SwapPage*[numPages];
+    for(unsigned int vpn = 0; vpn < numPages; vpn++)
     {
-        executable->ReadAt(Buffer + noffH.code.size, 
-            noffH.initData.size, noffH.initData.inFileAddr);
+        int start = vpn * PageSize;
+
+        if(start >= noffH.code.virtualAddr && start + PageSize <=
+                noffH.code.virtualAddr + noffH.code.size)
+            pages[vpn] = textCache->Get(sector, vpn);  // pure code
+        else
+            pages[vpn] = NULL;          // not touched yet
     }
-    char* swapname = itoa(tid);
-    fileSystem->Create(swapname, size);
-    swap = fileSystem->Open(swapname);
-    swap->WriteAt(Buffer,size,0);
+}
+
+//----------------------------------------------------------------------
+// ReadOverlap
+// 	Copy the part of segment "seg" of "executable" that falls within
+//	virtual page "vpn" into "page".
+//----------------------------------------------------------------------
 
-    delete [] Buffer;
+static void
+ReadOverlap(OpenFile *executable, Segment *seg, int vpn, char *page)
+{
+    int start = vpn * PageSize;
+    int end = start + PageSize;
+
+    if(seg->size <= 0 || seg->virtualAddr >= end ||
+        seg->virtualAddr + seg->size <= start)
+        return;
+    if(start < seg->virtualAddr)
+        start = seg->virtualAddr;
+    if(end > seg->virtualAddr + seg->size)
+        end = seg->virtualAddr + seg->size;
+    executable->ReadAt(page + start - vpn * PageSize, end - start,
+        seg->inFileAddr + start - seg->virtualAddr);
 }
 
-int 
-AddrSpace::transVirtualAddr(int virtualAddr)
+//----------------------------------------------------------------------
+// AddrSpace::InitialPage
+// 	Fill "page" with the initial contents of virtual page "vpn": code
+//	and initialized data from the executable, zeros everywhere else
+//	(uninitialized data and the stack).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::InitialPage(int vpn, char *page)
 {
-    if(virtualAddr >= noffH.code.virtualAddr && 
-        virtualAddr <= noffH.code.virtualAddr + noffH.code.size)
-    {
-        return virtualAddr - noffH.code.virtualAddr;
-    }
-    if(virtualAddr >= noffH.initData.virtualAddr && 
-        virtualAddr <= noffH.initData.virtualAddr + noffH.initData.size)
-    {
-        return virtualAddr - noffH.initData.virtualAddr + noffH.code.size;
-    }
-    if(virtualAddr >= noffH.uninitData.virtualAddr && 
-        virtualAddr <= noffH.uninitData.virtualAddr + noffH.uninitData.size)
-    {
-        return virtualAddr - noffH.uninitData.virtualAddr + noffH.code.size
-        + noffH.initData.size;
-    }
-    return 0;
-}
\ No newline at end of file
+    memset(page, 0, PageSize);
+    ReadOverlap(executable, &noffH.code, vpn, page);
+    ReadOverlap(executable, &noffH.initData, vpn, page);
+}
@@ -17,15 +17,18 @@
 #include "filesys.h"
 #include "list.h"
 #include "noff.h"  
+#include "swap.h"
+#include "translate.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
 
 class AddrSpace {
   public:
-    AddrSpace(OpenFile *executable, int tid = -1);	// Create an address space,
+    AddrSpace(OpenFile *file);		// Create an address space,
 					// initializing it with the program
-					// stored in the file "executable"
-    AddrSpace(AddrSpace *space, int tid = -1);
+					// stored in "file"
+    AddrSpace(AddrSpace *space);	// Fork "space", sharing
+					// its pages copy-on-write
 
     ~AddrSpace();			// De-allocate an address space
 
@@ -37,23 +40,37 @@ class AddrSpace {
 
     int getNumPages(){return numPages;}
 
-    int transVirtualAddr(int virtualAddr);
+    void InitialPage(int vpn, char *page);	// Contents of a page
+					// never written to swap
+    void ReleasePage(int vpn);		// Stop mapping a virtual page
+    bool Maps(TranslationEntry *frame);	// Does "frame" hold one of
+					// our pages?
 
     int TLBMissCount;
+    int TLBAccessCount;			// memory accesses made while this
+					// space was running (with a TLB)
     int PageFaultCount;
-#ifdef TLB_FIFO
-    List* TLBFIFO_List;
-#endif 
-    OpenFile *swap;
+    int asid;				// ID tagging this space's TLB entries
+    int asidGeneration;			// generation "asid" belongs to; the
+					// ID is stale if this is not
+					// machine->asidGeneration
+    SwapFile *swap;			// Where pages we write are kept
+    SwapPage **pages;			// Backing of each virtual page,
+					// possibly shared with other spaces;
+					// NULL until the page is touched
     unsigned int maxPagesinMem;
     unsigned int PagesinMem;
 
     NoffHeader noffH;
 
   private:
-    void LoadSwapSpace(OpenFile *executable,int tid);
+    void LoadExecutable(OpenFile *file);
+    OpenFile *executable;		// Our own handle on the program, to
+					// load pages from
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    int accessMark;			// machine->tlbAccesses when this
+					// space was last switched in, or -1
 };
 
 #endif // ADDRSPACE_H
@@ -1,6 +1,7 @@
 // bitmap.c 
 //	Routines to manage a bitmap -- an array of bits each of which
-//	can be either on or off.  Represented as an array of integers.
+//	can be either on or off.  Represented as an array of integers,
+//	with a summary of where the clear bits are; see bitmap.h.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -21,9 +22,14 @@ BitMap::BitMap(int nitems)
 { 
     numBits = nitems;
     numWords = divRoundUp(numBits, BitsInWord);
+    numGroups = divRoundUp(numWords, BitsInWord);
     map = new unsigned int[numWords];
-    for (int i = 0; i < numBits; i++) 
-        Clear(i);
+    dirty = new unsigned int[numGroups];
+    summary = new unsigned int[numGroups];
+    groupFree = new int[numGroups];
+    bzero((char *) map, numWords * sizeof(unsigned));
+    bzero((char *) dirty, numGroups * sizeof(unsigned));
+    Rebuild();
 }
 
 //----------------------------------------------------------------------
@@ -34,6 +40,35 @@ BitMap::BitMap(int nitems)
 BitMap::~BitMap()
 { 
     delete map;
+    delete [] dirty;
+    delete [] summary;
+    delete [] groupFree;
+}
+
+//----------------------------------------------------------------------
+// BitMap::Rebuild
+// 	Recompute the summary of clear bits from the bitmap itself, after
+//	it was initialized or read in.  The bits of the last word past
+//	the end of the bitmap are set, so that they are never found.
+//----------------------------------------------------------------------
+
+void
+BitMap::Rebuild()
+{
+    int w, free;
+
+    if (numBits % BitsInWord != 0)
+	map[numWords - 1] |= ~0u << (numBits % BitsInWord);
+    bzero((char *) summary, numGroups * sizeof(unsigned));
+    bzero((char *) groupFree, numGroups * sizeof(int));
+    numFree = 0;
+    for (w = 0; w < numWords; w++) {
+	free = __builtin_popcount(~map[w]);
+	if (free > 0)
+	    summary[w / BitsInWord] |= 1 << (w % BitsInWord);
+	groupFree[w / BitsInWord] += free;
+	numFree += free;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -46,8 +81,17 @@ BitMap::~BitMap()
 void
 BitMap::Mark(int which) 
 { 
+    int w = which / BitsInWord;
+
     ASSERT(which >= 0 && which < numBits);
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if (Test(which))
+	return;
+    map[w] |= 1 << (which % BitsInWord);
+    numFree--;
+    groupFree[w / BitsInWord]--;
+    if (map[w] == ~0u)
+	summary[w / BitsInWord] &= ~(1 << (w % BitsInWord));
+    SetDirty(which);
 }
     
 //----------------------------------------------------------------------
@@ -60,8 +104,36 @@ BitMap::Mark(int which)
 void 
 BitMap::Clear(int which) 
 {
+    int w = which / BitsInWord;
+
     ASSERT(which >= 0 && which < numBits);
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if (!Test(which))
+	return;
+    map[w] &= ~(1 << (which % BitsInWord));
+    numFree++;
+    groupFree[w / BitsInWord]++;
+    summary[w / BitsInWord] |= 1 << (w % BitsInWord);
+    SetDirty(which);
+}
+
+//----------------------------------------------------------------------
+// BitMap::SetDirty, BitMap::IsDirty
+// 	Note that the word of the bitmap holding bit "which" has changed,
+//	so that WriteDirty writes it; and ask whether word "word" has.
+//----------------------------------------------------------------------
+
+void
+BitMap::SetDirty(int which)
+{
+    int word = which / BitsInWord;
+
+    dirty[word / BitsInWord] |= 1 << (word % BitsInWord);
+}
+
+bool
+BitMap::IsDirty(int word)
+{
+    return (dirty[word / BitsInWord] & (1 << (word % BitsInWord))) != 0;
 }
 
 //----------------------------------------------------------------------
@@ -82,6 +154,64 @@ BitMap::Test(int which)
 	return FALSE;
 }
 
+//----------------------------------------------------------------------
+// BitMap::NextClear
+// 	Return the number of the first clear bit at or after "from", or
+//	-1 if there is none.  Groups with no clear bits are skipped by
+//	their count, words with none by the summary, and the bit within
+//	a word found by counting trailing zeros.
+//----------------------------------------------------------------------
+
+int
+BitMap::NextClear(int from)
+{
+    int w, g;
+    unsigned int bits;
+
+    if (from >= numBits)
+	return -1;
+    w = from / BitsInWord;
+    bits = ~map[w] & (~0u << (from % BitsInWord));
+    if (bits != 0)
+	return w * BitsInWord + __builtin_ctz(bits);
+
+    g = w / BitsInWord;			// the rest of this group
+    if (w % BitsInWord == BitsInWord - 1)
+	bits = 0;
+    else
+	bits = summary[g] & (~0u << (w % BitsInWord + 1));
+    while (bits == 0) {			// then the next group with any
+	for (g++; g < numGroups && groupFree[g] == 0; g++)
+	    ;
+	if (g == numGroups)
+	    return -1;
+	bits = summary[g];
+    }
+    w = g * BitsInWord + __builtin_ctz(bits);
+    return w * BitsInWord + __builtin_ctz(~map[w]);
+}
+
+//----------------------------------------------------------------------
+// BitMap::RunEnd
+// 	Return the number of the first set bit at or after "from", a word
+//	at a time, or "limit" if there is none before it.
+//----------------------------------------------------------------------
+
+int
+BitMap::RunEnd(int from, int limit)
+{
+    int w = from / BitsInWord;
+    unsigned int bits = map[w] & (~0u << (from % BitsInWord));
+
+    if (limit > numBits)
+	limit = numBits;
+    while (bits == 0 && (w + 1) * BitsInWord < limit)
+	bits = map[++w];
+    if (bits == 0)
+	return limit;
+    return min(w * BitsInWord + __builtin_ctz(bits), limit);
+}
+
 //----------------------------------------------------------------------
 // BitMap::Find
 // 	Return the number of the first bit which is clear.
@@ -94,12 +224,77 @@ BitMap::Test(int which)
 int 
 BitMap::Find() 
 {
-    for (int i = 0; i < numBits; i++)
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
+    return FindNear(0);
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindNear
+// 	Like Find, but return the first clear bit at or after "hint" if
+//	there is one, wrapping around to the start of the bitmap if not.
+//	Allocating each disk sector near the last keeps a file together.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindNear(int hint)
+{
+    int i;
+
+    if (numFree == 0)
+	return -1;
+    if (hint < 0 || hint >= numBits)
+	hint = 0;
+    i = NextClear(hint);
+    if (i == -1)
+	i = NextClear(0);
+    Mark(i);
+    return i;
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindRun
+// 	Allocate a run of up to "want" clear bits in a row.  A run
+//	starting right at "near" is taken even if it is short; otherwise
+//	we take the first run, searching upwards from "near", long enough
+//	for all of them, or failing that the longest run there is.
+//
+//	Return the number of the first bit of the run, and set "got" to
+//	its length.  If no bits are clear, return -1.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindRun(int near, int want, int *got)
+{
+    int i, len, bestStart = -1, bestLen = 0;
+    bool wrapped = FALSE;
+
+    if (near < 0 || near >= numBits)
+	near = 0;
+    for (i = NextClear(near); ; i = NextClear(i + len)) {
+	if (i == -1) {				// past the end; start over
+	    if (wrapped || near == 0)
+		break;
+	    wrapped = TRUE;
+	    i = NextClear(0);
+	    if (i == -1)
+		break;
+	}
+	if (wrapped && i >= near)
+	    break;
+	len = RunEnd(i, i + want) - i;
+	if (len == want || i == near) {
+	    bestStart = i;
+	    bestLen = len;
+	    break;
 	}
-    return -1;
+	if (len > bestLen) {
+	    bestStart = i;
+	    bestLen = len;
+	}
+    }
+    for (i = 0; i < bestLen; i++)
+	Mark(bestStart + i);
+    *got = bestLen;
+    return bestStart;
 }
 
 //----------------------------------------------------------------------
@@ -111,11 +306,7 @@ BitMap::Find()
 int 
 BitMap::NumClear() 
 {
-    int count = 0;
-
-    for (int i = 0; i < numBits; i++)
-	if (!Test(i)) count++;
-    return count;
+    return numFree;
 }
 
 //----------------------------------------------------------------------
@@ -149,6 +340,8 @@ void
 BitMap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    bzero((char *) dirty, numGroups * sizeof(unsigned));
+    Rebuild();
 }
 
 //----------------------------------------------------------------------
@@ -162,4 +355,34 @@ void
 BitMap::WriteBack(OpenFile *file)
 {
     file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    bzero((char *) dirty, numGroups * sizeof(unsigned));
+}
+
+//----------------------------------------------------------------------
+// BitMap::WriteDirty
+// 	Store to a Nachos file only the words of the bitmap changed since
+//	it was last fetched or written, each run of adjacent changed words
+//	with one write.  For a large bitmap kept in memory, like the map
+//	of free sectors, an allocation then costs a sector or two rather
+//	than the whole file.
+//
+//	"file" is the place to write the bitmap to
+//----------------------------------------------------------------------
+
+void
+BitMap::WriteDirty(OpenFile *file)
+{
+    int first, last;
+
+    for (first = 0; first < numWords; first = last) {
+	if (!IsDirty(first)) {
+	    last = first + 1;
+	    continue;
+	}
+	for (last = first + 1; last < numWords && IsDirty(last); last++)
+	    ;
+	file->WriteAt((char *) &map[first], (last - first) * sizeof(unsigned),
+						first * sizeof(unsigned));
+    }
+    bzero((char *) dirty, numGroups * sizeof(unsigned));
 }
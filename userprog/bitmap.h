@@ -8,6 +8,13 @@
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
 //
+//	So that a large bitmap (the map of free disk sectors, say) need not
+//	be scanned bit by bit, a summary is kept up to date alongside it:
+//	one bit per word, set if the word has a clear bit, and for each
+//	group of BitsInWord words a count of its clear bits.  A clear bit
+//	is then found by skipping whole groups, and within a group whole
+//	words, and the number of clear bits is always known.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -43,6 +50,12 @@ class BitMap {
     int Find();            	// Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
+    int FindNear(int hint);	// Same, preferring the first clear bit
+				// at or after "hint"
+    int FindRun(int near, int want, int *got);
+				// Find and set up to "want" clear bits
+				// in a row, if possible starting at
+				// "near"; return the first, or -1
     int NumClear();		// Return the number of clear bits
 
     void Print();		// Print contents of bitmap
@@ -51,14 +64,31 @@ class BitMap {
     // write the bitmap to a file
     void FetchFrom(OpenFile *file); 	// fetch contents from disk 
     void WriteBack(OpenFile *file); 	// write contents to disk
+    void WriteDirty(OpenFile *file);	// write only the words changed
+					// since the last fetch or write
 
   private:
+    void SetDirty(int which);		// Note the word holding bit "which"
+					// was changed
+    bool IsDirty(int word);
+    void Rebuild();			// Recompute the summary from "map"
+    int NextClear(int from);		// First clear bit at or after "from"
+    int RunEnd(int from, int limit);	// First set bit at or after "from",
+					// or "limit" if none before it
+
     int numBits;			// number of bits in the bitmap
     int numWords;			// number of words of bitmap storage
 					// (rounded up if numBits is not a
 					//  multiple of the number of bits in
 					//  a word)
     unsigned int *map;			// bit storage
+    unsigned int *dirty;		// one bit per word of "map", set
+					// when the word is changed
+    int numGroups;			// number of words of summary
+    unsigned int *summary;		// one bit per word of "map", set
+					// when the word has a clear bit
+    int *groupFree;			// clear bits in each group of words
+    int numFree;			// clear bits in all
 };
 
 #endif // BITMAP_H
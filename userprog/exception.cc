@@ -70,8 +70,13 @@ void SysExit()
     int exitNum = machine->ReadRegister(4);
     scheduler->setExitNum(currentThread->gettid(), exitNum);
     printf("EXIT NUM : %d\n", exitNum);
-    printf("Total TLB miss : %d\n",
-            currentThread->space->TLBMissCount);
+    AddrSpace *space = currentThread->space;
+    space->SaveState();         // bring the access count up to date
+    printf("Total TLB miss : %d\n", space->TLBMissCount);
+    if(space->TLBAccessCount > 0)
+        printf("TLB miss rate : %d/%d (%.2f%%)\n", space->TLBMissCount,
+            space->TLBAccessCount,
+            100.0 * space->TLBMissCount / space->TLBAccessCount);
     printf("Total Page Fault : %d\n",
             currentThread->space->PageFaultCount);
     currentThread->Print();
@@ -260,6 +265,7 @@ void SysYield()
 
 void ForkRun(int startAddr)
 {
+    currentThread->space->RestoreState();      // select our TLB entries
 
     machine->WriteRegister(PCReg, startAddr);
     machine->WriteRegister(NextPCReg, startAddr + 4);
@@ -273,15 +279,10 @@ void SysFork()
 {
     int startAddr = machine->ReadRegister(4);
 
-    machine->RefreshSwap();
-
     Thread* t = new Thread("ForkThread");
-    if(t->gettid() != -1)
-    {
-        t->space = new AddrSpace(currentThread->space, t->gettid());
+    t->space = new AddrSpace(currentThread->space);
 
-        t->Fork(ForkRun, startAddr);
-    }
+    t->Fork(ForkRun, startAddr);
 }
 
 void ExecRun()
@@ -305,22 +306,19 @@ void SysExec()
     }while(value != 0 && count < 10);
 
     Thread *t = new Thread("forked thread");
-    if(t->gettid() != -1)
-    {
-        OpenFile *executable = fileSystem->Open(filename);
-        AddrSpace *space;
+    OpenFile *executable = fileSystem->Open(filename);
+    AddrSpace *space;
 
-        if (executable == NULL) {
-        printf("Unable to open file %s\n", filename);
-        return;
-        }
-        space = new AddrSpace(executable, t->gettid());    
-        t->space = space;
+    if (executable == NULL) {
+    printf("Unable to open file %s\n", filename);
+    return;
+    }
+    space = new AddrSpace(executable);    
+    t->space = space;
 
-        delete executable;          // close file
+    delete executable;          // close file
 
-        t->Fork(ExecRun, 0);
-    }
+    t->Fork(ExecRun, 0);
 
     machine->WriteRegister(2, t->gettid());
 }
@@ -328,11 +326,7 @@ void SysExec()
 void SysJoin()
 {
     int spaceId = machine->ReadRegister(4);
-    while(scheduler->isActive(spaceId))
-    {
-        currentThread->Yield();
-    }
-    int exitNum = scheduler->getExitNum(spaceId);
+    int exitNum = scheduler->Join(spaceId);
 
     machine->WriteRegister(2, exitNum);
 }
@@ -541,6 +535,12 @@ ExceptionHandler(ExceptionType which)
         currentThread->space->PageFaultCount++;
         stats->numPageFaults++;
     }
+    else if ((which == ReadOnlyException))
+    {
+        DEBUG('a', "handle ReadOnly\n");
+        int addr = machine->ReadRegister(BadVAddrReg);
+        machine->CopyOnWrite(addr);
+    }
     else{
 	printf("Unexpected user mode exception %d %d\n", which, type);
 	ASSERT(FALSE);
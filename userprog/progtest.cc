@@ -83,10 +83,6 @@ ConsoleTest (char *in, char *out)
     
     
     Thread *t = new Thread("forked thread", 1);
-    if(t->gettid() == -1)
-    {
-        printf("can't fork!\n");
-    }
     t->Fork(useConsole, 0);
     
 
@@ -158,11 +154,6 @@ ConsoleTest (char *in, char *out)
             printf("hahaha\n");
             #endif
             Thread *t = new Thread("forked thread", 1);
-            if(t->gettid() == -1)
-            {
-                printf("can't fork!\n");
-                continue;
-            }
             char* filename = "halt.coff";
             t->Fork(StartProcess, (void*)filename);
         }
@@ -171,11 +162,6 @@ ConsoleTest (char *in, char *out)
         {
             int priority = ch - '0';
             Thread *t = new Thread("forked thread", 1, priority);
-            if(t->gettid() == -1)
-            {
-                printf("can't fork!\n");
-                continue;
-            }
             t->Fork(PrintThread, (void*)1);
         }
     }
@@ -0,0 +1,268 @@
+// swap.cc
+//	Routines to manage the swap files backing user address spaces,
+//	and the page slots within them.  See swap.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "swap.h"
+
+static int swapFileCount = 0;		// for naming swap files
+
+//----------------------------------------------------------------------
+// SwapFile::SwapFile
+// 	Initialize an empty swap file, with a name not used by any other
+//	swap file.  The Nachos file is not created until a page is
+//	written.  The reference of the creating address space is already
+//	counted.
+//----------------------------------------------------------------------
+
+SwapFile::SwapFile()
+{
+    sprintf(name, "swap%d", swapFileCount++);
+    file = NULL;
+    refs = 1;
+    numSlots = 0;
+    freeSlots = new List;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::~SwapFile
+// 	Close the swap file and remove it from the file system, if it was
+//	ever created.
+//----------------------------------------------------------------------
+
+SwapFile::~SwapFile()
+{
+    if (file != NULL) {
+	delete file;
+	fileSystem->Remove(name, "/", TRUE);
+    }
+    delete freeSlots;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::AllocSlot
+// 	Return a page slot no one is using, preferring one given back
+//	before, so the file only grows when every slot is in use.
+//----------------------------------------------------------------------
+
+int
+SwapFile::AllocSlot()
+{
+    if (!freeSlots->IsEmpty())
+	return (int) freeSlots->Remove();
+    return numSlots++;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::FreeSlot
+// 	Give back a page slot, to be handed out again.
+//----------------------------------------------------------------------
+
+void
+SwapFile::FreeSlot(int slot)
+{
+    freeSlots->Append((void *) slot);
+}
+
+//----------------------------------------------------------------------
+// SwapFile::ReadSlot, SwapFile::WriteSlot
+// 	Transfer one page between a slot of the swap file and a buffer.
+//	The file is created by the first write (creating it can block, so
+//	another write may have created it by the time we have opened it).
+//----------------------------------------------------------------------
+
+void
+SwapFile::ReadSlot(int slot, char *into)
+{
+    ASSERT(file != NULL);
+    file->ReadAt(into, PageSize, slot * PageSize);
+}
+
+void
+SwapFile::WriteSlot(int slot, char *from)
+{
+    if (file == NULL) {
+	OpenFile *opened;
+
+	DEBUG('a', "creating swap file %s\n", name);
+	fileSystem->Create(name, 0);
+	opened = fileSystem->Open(name);
+	ASSERT(opened != NULL);
+	if (file == NULL)
+	    file = opened;
+	else
+	    delete opened;
+    }
+    file->WriteAt(from, PageSize, slot * PageSize);
+}
+
+//----------------------------------------------------------------------
+// SwapFile::Unref
+// 	Drop a reference to the swap file, deleting it with the last one.
+//----------------------------------------------------------------------
+
+void
+SwapFile::Unref()
+{
+    ASSERT(refs > 0);
+    if (--refs == 0)
+	delete this;
+}
+
+//----------------------------------------------------------------------
+// SwapPage::SwapPage
+// 	A page to be kept in swap file "f".  It has no slot until it is
+//	first written.  The page is mapped by the address space creating
+//	it.
+//----------------------------------------------------------------------
+
+SwapPage::SwapPage(SwapFile *f)
+{
+    file = f;
+    file->Ref();
+    slot = -1;
+    refs = 1;
+    textSector = textPage = -1;
+    nextText = NULL;
+}
+
+//----------------------------------------------------------------------
+// SwapPage::SwapPage
+// 	A code page, virtual page "vpn" of the executable whose file
+//	header is at "sector".  It is always loaded from the executable,
+//	so it has no swap file.  Only TextCache::Get creates these.
+//----------------------------------------------------------------------
+
+SwapPage::SwapPage(int sector, int vpn)
+{
+    file = NULL;
+    slot = -1;
+    refs = 1;
+    textSector = sector;
+    textPage = vpn;
+    nextText = NULL;
+}
+
+//----------------------------------------------------------------------
+// SwapPage::~SwapPage
+// 	Give the slot, if any, back to its swap file.  A code page is
+//	taken out of the TextCache instead.
+//----------------------------------------------------------------------
+
+SwapPage::~SwapPage()
+{
+    if (IsText()) {
+	textCache->Remove(this);
+	return;
+    }
+    if (slot >= 0)
+	file->FreeSlot(slot);
+    file->Unref();
+}
+
+//----------------------------------------------------------------------
+// SwapPage::Read, SwapPage::Write
+// 	Transfer the page between swap and a page-sized buffer.  The
+//	swap file is held across the transfer, since it may block and
+//	the page be released meanwhile.
+//----------------------------------------------------------------------
+
+void
+SwapPage::Read(char *into)
+{
+    SwapFile *f = file;
+
+    ASSERT(slot >= 0);
+    f->Ref();
+    f->ReadSlot(slot, into);
+    f->Unref();
+}
+
+void
+SwapPage::Write(char *from)
+{
+    SwapFile *f = file;
+
+    ASSERT(!IsText());
+    if (slot < 0)
+	slot = f->AllocSlot();
+    f->Ref();
+    f->WriteSlot(slot, from);
+    f->Unref();
+}
+
+//----------------------------------------------------------------------
+// TextHash
+// 	Bucket of the TextCache for code page "vpn" of the executable at
+//	"sector".
+//----------------------------------------------------------------------
+
+static int
+TextHash(int sector, int vpn)
+{
+    return (unsigned) (sector * 31 + vpn) % TextCacheSize;
+}
+
+//----------------------------------------------------------------------
+// TextCache::TextCache, TextCache::~TextCache
+// 	Initialize an empty cache of shared code pages; deallocate it.
+//----------------------------------------------------------------------
+
+TextCache::TextCache()
+{
+    buckets = new SwapPage*[TextCacheSize];
+    for (int i = 0; i < TextCacheSize; i++)
+	buckets[i] = NULL;
+}
+
+TextCache::~TextCache()
+{
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// TextCache::Get
+// 	Return the SwapPage for code page "vpn" of the executable whose
+//	header is at "sector", with a reference added for the caller.  If
+//	no address space maps it yet, a new one is made.
+//----------------------------------------------------------------------
+
+SwapPage *
+TextCache::Get(int sector, int vpn)
+{
+    int bucket = TextHash(sector, vpn);
+    SwapPage *page;
+
+    for (page = buckets[bucket]; page != NULL; page = page->nextText)
+	if (page->textSector == sector && page->textPage == vpn) {
+	    page->refs++;
+	    stats->numTextShared++;
+	    return page;
+	}
+    page = new SwapPage(sector, vpn);
+    page->nextText = buckets[bucket];
+    buckets[bucket] = page;
+    return page;
+}
+
+//----------------------------------------------------------------------
+// TextCache::Remove
+// 	Forget a code page that no address space maps any more.
+//----------------------------------------------------------------------
+
+void
+TextCache::Remove(SwapPage *page)
+{
+    SwapPage **ptr = &buckets[TextHash(page->textSector, page->textPage)];
+
+    for (; *ptr != NULL; ptr = &(*ptr)->nextText)
+	if (*ptr == page) {
+	    *ptr = page->nextText;
+	    return;
+	}
+}
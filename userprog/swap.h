@@ -0,0 +1,99 @@
+// swap.h
+//	Data structures for the backing store of user address spaces.
+//
+//	Every address space has a swap file, a Nachos file holding the
+//	pages it has written.  Each virtual page that has been touched is
+//	backed by a SwapPage, which gets a page-sized slot of some swap
+//	file the first time it is evicted dirty; until then its contents
+//	come from the executable (or are zero).  The file itself is only
+//	created when its first slot is written.  After a fork, parent and
+//	child point at the same SwapPages (and physical frames), and a
+//	page is only copied, into the writer's own swap file, when one of
+//	them writes to it.
+//
+//	Pages holding nothing but code are never written, so they need no
+//	swap at all.  They are kept in a system-wide TextCache, so that
+//	every address space running the same executable maps the same
+//	SwapPage, and so the same frame.
+//
+//	Both are reference counted: a SwapPage by the address spaces
+//	mapping it, a SwapFile by its owning address space and the
+//	SwapPages in it.  The file is removed when the last one goes.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "copyright.h"
+#include "openfile.h"
+#include "list.h"
+
+class SwapFile {
+  public:
+    SwapFile();				// Initialize an empty swap file
+    ~SwapFile();			// Close and remove it, if created
+
+    int AllocSlot();			// Return a free page slot
+    void FreeSlot(int slot);		// Give a slot back for reuse
+    void ReadSlot(int slot, char *into);	// Transfer one page
+    void WriteSlot(int slot, char *from);
+
+    void Ref() { refs++; }		// Add a reference
+    void Unref();			// Drop one, deleting the file when
+					// it was the last
+
+  private:
+    OpenFile *file;			// The open swap file, or NULL if
+					// nothing has been written yet
+    char name[16];			// Its name in the root directory
+    int refs;				// References held
+    int numSlots;			// Slots handed out so far; the file
+					// grows as they are written
+    List *freeSlots;			// Slots given back, to reuse first
+};
+
+#define TextCacheSize	64		// buckets in the TextCache hash
+
+class SwapPage {
+  public:
+    SwapPage(SwapFile *f);		// A page to be kept in "f" once
+					// it is written
+    SwapPage(int sector, int vpn);	// Code page "vpn" of the executable
+					// whose header is at "sector"
+    ~SwapPage();			// Give its slot back
+
+    bool InSwap() { return slot >= 0; }	// Has it been written?
+    bool IsText() { return textSector >= 0; }	// Is it a shared code
+					// page (which is never written)?
+    void Read(char *into);		// Read the page from swap
+    void Write(char *from);		// Write the page to swap, taking
+					// a slot the first time
+
+    SwapFile *file;			// File and slot holding the page;
+    int slot;				// the slot is -1 until written
+    int refs;				// Address spaces mapping it; the
+					// page is shared copy-on-write
+					// while this is more than 1
+
+    int textSector, textPage;		// Key in the TextCache, or -1
+    SwapPage *nextText;			// Next page in the same bucket
+};
+
+class TextCache {
+  public:
+    TextCache();			// Initialize an empty cache
+    ~TextCache();
+
+    SwapPage *Get(int sector, int vpn);	// Map code page "vpn" of the
+					// executable at "sector", sharing
+					// it if someone already does
+    void Remove(SwapPage *page);	// Called as a code page is deleted
+
+  private:
+    SwapPage **buckets;			// Hash by (sector, vpn)
+};
+
+#endif // SWAP_H